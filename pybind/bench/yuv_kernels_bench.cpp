@@ -0,0 +1,101 @@
+// Compares the native NV12 -> BGR24 kernels against libswscale on a synthetic 1080p frame.
+// Build with -DCHIAKI_PY_BUILD_BENCHMARKS=ON and run yuv_kernels_bench [width height iterations].
+
+#include "yuv_kernels.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+extern "C"
+{
+#include <libavutil/imgutils.h>
+#include <libswscale/swscale.h>
+}
+
+template <typename F>
+static double MeasureMs(int iterations, F &&f)
+{
+    f(); // warm up caches and lazily initialized tables
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < iterations; i++)
+        f();
+    auto end = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::milli>(end - start).count() / iterations;
+}
+
+int main(int argc, char **argv)
+{
+    int width = argc > 2 ? atoi(argv[1]) : 1920;
+    int height = argc > 2 ? atoi(argv[2]) : 1080;
+    int iterations = argc > 3 ? atoi(argv[3]) : 200;
+    if (width <= 0 || height <= 0 || iterations <= 0)
+    {
+        fprintf(stderr, "usage: %s [width height [iterations]]\n", argv[0]);
+        return 1;
+    }
+
+    int chroma_height = (height + 1) / 2;
+    int y_stride = FFALIGN(width, 64);
+    int uv_stride = FFALIGN((width + 1) & ~1, 64);
+    std::vector<uint8_t> y_plane((size_t)y_stride * height);
+    std::vector<uint8_t> uv_plane((size_t)uv_stride * chroma_height);
+    srand(1);
+    for (auto &v : y_plane)
+        v = (uint8_t)(16 + rand() % 220);
+    for (auto &v : uv_plane)
+        v = (uint8_t)(16 + rand() % 225);
+
+    int rgb_stride = width * 3;
+    std::vector<uint8_t> rgb_swscale((size_t)rgb_stride * height);
+    std::vector<uint8_t> rgb_native((size_t)rgb_stride * height);
+
+    SwsContext *sws = sws_getContext(width, height, AV_PIX_FMT_NV12, width, height, AV_PIX_FMT_BGR24, SWS_BILINEAR, nullptr, nullptr, nullptr);
+    if (!sws)
+    {
+        fprintf(stderr, "Failed to create SwsContext\n");
+        return 1;
+    }
+    const int *coefficients = sws_getCoefficients(SWS_CS_ITU709);
+    sws_setColorspaceDetails(sws, coefficients, 0, coefficients, 1, 0, 1 << 16, 1 << 16);
+
+    const uint8_t *src_data[4] = {y_plane.data(), uv_plane.data(), nullptr, nullptr};
+    int src_linesize[4] = {y_stride, uv_stride, 0, 0};
+    uint8_t *dst_data[4] = {rgb_swscale.data(), nullptr, nullptr, nullptr};
+    int dst_linesize[4] = {rgb_stride, 0, 0, 0};
+
+    // get_frame used to convert into an intermediate frame and copy that into the target
+    std::vector<uint8_t> rgb_target((size_t)rgb_stride * height);
+    double swscale_ms = MeasureMs(iterations, [&]()
+                                  { sws_scale(sws, src_data, src_linesize, 0, height, dst_data, dst_linesize); });
+    double swscale_copy_ms = MeasureMs(iterations, [&]()
+                                       {
+        sws_scale(sws, src_data, src_linesize, 0, height, dst_data, dst_linesize);
+        av_image_copy_plane(rgb_target.data(), rgb_stride, rgb_swscale.data(), rgb_stride, rgb_stride, height); });
+
+    YuvImage yuv = {{y_plane.data(), uv_plane.data(), nullptr}, {y_stride, uv_stride, 0}, width, height, YuvChromaLayout::NV12, YuvColorMatrix::BT709, false};
+    RgbImage rgb = {rgb_native.data(), rgb_stride, RgbPixelLayout::BGR24};
+    double native_ms = MeasureMs(iterations, [&]()
+                                 { ConvertYuvToRgb(yuv, rgb, 0, height); });
+
+    // Chroma upsampling differs (bilinear vs. duplication), so only report how close the outputs are
+    long long diff_sum = 0;
+    int diff_max = 0;
+    for (size_t i = 0; i < rgb_native.size(); i++)
+    {
+        int d = abs((int)rgb_native[i] - (int)rgb_swscale[i]);
+        diff_sum += d;
+        diff_max = d > diff_max ? d : diff_max;
+    }
+
+    printf("%dx%d NV12 -> BGR24, %d iterations\n", width, height, iterations);
+    printf("  swscale:          %8.3f ms/frame\n", swscale_ms);
+    printf("  swscale + copy:   %8.3f ms/frame\n", swscale_copy_ms);
+    printf("  native (%s): %8.3f ms/frame (%.2fx vs. swscale, %.2fx vs. swscale + copy)\n", GetYuvKernelName(), native_ms,
+           swscale_ms / native_ms, swscale_copy_ms / native_ms);
+    printf("  mean abs diff %.3f, max %d\n", (double)diff_sum / rgb_native.size(), diff_max);
+
+    sws_freeContext(sws);
+    return 0;
+}
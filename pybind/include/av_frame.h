@@ -21,6 +21,15 @@ public:
 
     PyAVFrame();
 
+    /**
+     * Creates a new reference to the buffers of src, no pixel data is copied.
+     */
+    explicit PyAVFrame(const AVFrame *src);
+
+    PyAVFrame(PyAVFrame &&other) noexcept;
+    PyAVFrame(const PyAVFrame &) = delete;
+    PyAVFrame &operator=(const PyAVFrame &) = delete;
+
     ~PyAVFrame();
 
     int width() const { return frame->width; }
@@ -35,9 +44,25 @@ public:
     int64_t pts() const { return frame->pts; }
     void set_pts(int64_t pts) { frame->pts = pts; }
 
+    int plane_count() const;
+
     py::bytes data(int index);
 
+    /**
+     * Returns a view on the given plane. The array keeps its own reference to the frame buffers,
+     * which is dropped when the last view on it is released.
+     */
     py::array_t<uint8_t> to_numpy(int index);
+
+    py::list planes();
+
+    /**
+     * DLPack export of frames with a single plane in system memory, sharing the frame buffers like to_numpy().
+     * Planar and hardware frames raise BufferError, as do a dl_device other than the CPU and copy=True.
+     * Always returns an unversioned capsule, whatever max_version is.
+     */
+    py::capsule dlpack(py::object stream, py::object max_version, py::object dl_device, py::object copy);
+    py::tuple dlpack_device();
 };
 
-#endif // CHIAKI_PY_AV_FRAME_H
\ No newline at end of file
+#endif // CHIAKI_PY_AV_FRAME_H
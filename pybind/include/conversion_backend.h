@@ -0,0 +1,12 @@
+#ifndef CHIAKI_PY_CONVERSION_BACKEND_H
+#define CHIAKI_PY_CONVERSION_BACKEND_H
+
+enum class ConversionBackend
+{
+    /** libswscale, supports every format pair */
+    Swscale,
+    /** Hand-vectorized kernels for NV12/YUV420P to packed RGB, falls back to libswscale for anything else */
+    Native
+};
+
+#endif // CHIAKI_PY_CONVERSION_BACKEND_H
@@ -38,6 +38,14 @@ class BitstreamWrapper : public StructWrapper<ChiakiBitstream>
 private:
     LogWrapper log;
 
+    static py::buffer_info request_bytes(py::buffer &data, bool writable)
+    {
+        py::buffer_info info = data.request(writable);
+        if (info.ndim != 1 || info.strides[0] != info.itemsize)
+            throw py::buffer_error("Data must be a contiguous one-dimensional buffer");
+        return info;
+    }
+
 public:
     using StructWrapper::StructWrapper;
 
@@ -72,6 +80,26 @@ public:
     {
         return chiaki_bitstream_slice_set_reference_frame(ptr(), data.data(), data.size(), reference_frame);
     }
+
+    // Overloads parsing bytes, bytearrays or memoryviews in place instead of copying them into a vector
+
+    bool header(py::buffer data)
+    {
+        py::buffer_info info = request_bytes(data, false);
+        return chiaki_bitstream_header(ptr(), static_cast<uint8_t *>(info.ptr), info.size * info.itemsize);
+    }
+
+    bool slice(py::buffer data, BitstreamSliceWrapper &slice)
+    {
+        py::buffer_info info = request_bytes(data, false);
+        return chiaki_bitstream_slice(ptr(), static_cast<uint8_t *>(info.ptr), info.size * info.itemsize, slice.ptr());
+    }
+
+    bool slice_set_reference_frame(py::buffer data, unsigned reference_frame)
+    {
+        py::buffer_info info = request_bytes(data, true);
+        return chiaki_bitstream_slice_set_reference_frame(ptr(), static_cast<uint8_t *>(info.ptr), info.size * info.itemsize, reference_frame);
+    }
 };
 
 #endif // CHIAKI_PY_CORE_BITSTREAM_H
\ No newline at end of file
@@ -0,0 +1,58 @@
+#ifndef CHIAKI_PY_DLPACK_H
+#define CHIAKI_PY_DLPACK_H
+
+#include <cstdint>
+
+/**
+ * The subset of the DLPack ABI (dlpack.h, version 0.8) needed to export CPU tensors.
+ * Layouts and values must match the upstream header exactly.
+ */
+
+extern "C"
+{
+    typedef enum
+    {
+        kDLCPU = 1,
+    } DLDeviceType;
+
+    typedef struct
+    {
+        DLDeviceType device_type;
+        int32_t device_id;
+    } DLDevice;
+
+    typedef enum
+    {
+        kDLInt = 0U,
+        kDLUInt = 1U,
+        kDLFloat = 2U,
+    } DLDataTypeCode;
+
+    typedef struct
+    {
+        uint8_t code;
+        uint8_t bits;
+        uint16_t lanes;
+    } DLDataType;
+
+    typedef struct
+    {
+        void *data;
+        DLDevice device;
+        int32_t ndim;
+        DLDataType dtype;
+        int64_t *shape;
+        /** In elements, not bytes */
+        int64_t *strides;
+        uint64_t byte_offset;
+    } DLTensor;
+
+    typedef struct DLManagedTensor
+    {
+        DLTensor dl_tensor;
+        void *manager_ctx;
+        void (*deleter)(struct DLManagedTensor *self);
+    } DLManagedTensor;
+}
+
+#endif // CHIAKI_PY_DLPACK_H
@@ -0,0 +1,78 @@
+#ifndef CHIAKI_PY_EVENT_DISPATCHER_H
+#define CHIAKI_PY_EVENT_DISPATCHER_H
+
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <thread>
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * Delivers events to Python on a thread of its own.
+ *
+ * Native threads post events into a bounded lock-free multi producer queue without touching the GIL.
+ * The dispatch thread drains it in batches and calls the events with the GIL held, so a slow Python callback
+ * only delays other callbacks instead of the decoder or network threads. Events posted while the queue is
+ * full are dropped and counted. Delayed events are rare, they are kept in a separate list under the mutex.
+ */
+class EventDispatcher
+{
+public:
+    typedef std::function<void()> Event;
+
+    /**
+     * @param capacity number of queued events, rounded up to a power of two
+     * @param batch_size number of events delivered per acquisition of the GIL
+     */
+    explicit EventDispatcher(size_t capacity = 1024, size_t batch_size = 64);
+    ~EventDispatcher();
+
+    EventDispatcher(const EventDispatcher &) = delete;
+    EventDispatcher &operator=(const EventDispatcher &) = delete;
+
+    /**
+     * Queues event, callable from any thread.
+     * @return false if the queue was full or the dispatcher stopped, the event is dropped then
+     */
+    bool Post(Event event);
+
+    /**
+     * Queues event to be delivered once when has passed, callable from any thread. Events still waiting when
+     * the dispatcher stops are dropped.
+     * @return false if the dispatcher stopped
+     */
+    bool PostAt(Event event, std::chrono::steady_clock::time_point when);
+
+    /**
+     * Delivers the events still queued and joins the dispatch thread, releasing the GIL while waiting.
+     * Called from one of its own events, the thread is detached instead and the remaining events are dropped.
+     */
+    void Stop();
+
+    /**
+     * Calls event and reports any exception it raised as unraisable instead of throwing it. Needs the GIL.
+     */
+    static void Invoke(const Event &event);
+
+    /**
+     * True on a dispatch thread whose dispatcher was destroyed by the event it is running, whatever the event
+     * points to is gone then.
+     */
+    static bool IsCurrentDetached();
+
+    bool IsDispatchThread() const { return std::this_thread::get_id() == thread_id; }
+    bool IsStopping() const;
+    size_t GetCapacity() const;
+    uint64_t GetDroppedCount() const;
+
+private:
+    struct Queue;
+    std::shared_ptr<Queue> queue;
+    std::thread thread;
+    std::thread::id thread_id;
+
+    static void Run(std::shared_ptr<Queue> queue);
+};
+
+#endif // CHIAKI_PY_EVENT_DISPATCHER_H
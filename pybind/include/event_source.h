@@ -15,11 +15,84 @@
 #include <stdexcept>
 #include <iostream>
 #include <mutex>
+#include <atomic>
+#include <memory>
+#include <iterator>
+#include <type_traits>
+#include <deque>
+#include <chrono>
+#include <condition_variable>
+#include <cmath>
+#include <thread>
+
+#include "event_dispatcher.h"
 
 namespace py = pybind11;
 
 void init_event_source(py::module &m);
 
+/**
+ * What a dispatched EventSource does with a value while its pending queue is full.
+ */
+enum class BackpressurePolicy
+{
+    DropOldest,     // discard the oldest pending value
+    DropNewest,     // discard the new value
+    CoalesceLatest, // keep a single pending value, a new one replaces it
+    Block,          // make the emitting thread wait for room, up to a timeout
+};
+
+/**
+ * Subscription callbacks running on this thread, innermost first, so unsubscribe() can tell a callback that
+ * unsubscribes itself from one running on another thread.
+ */
+struct SubscriptionCall
+{
+    const void *subscription;
+    const SubscriptionCall *outer;
+
+    explicit SubscriptionCall(const void *subscription) : subscription(subscription), outer(innermost) { innermost = this; }
+    ~SubscriptionCall() { innermost = outer; }
+
+    SubscriptionCall(const SubscriptionCall &) = delete;
+    SubscriptionCall &operator=(const SubscriptionCall &) = delete;
+
+    static bool IsRunning(const void *subscription)
+    {
+        for (const SubscriptionCall *call = innermost; call; call = call->outer)
+        {
+            if (call->subscription == subscription)
+                return true;
+        }
+        return false;
+    }
+
+    static inline thread_local const SubscriptionCall *innermost = nullptr;
+};
+
+/**
+ * Observable emitting values to Python subscribers and native C++ subscribers.
+ *
+ * The subscribers are kept in an immutable list that is replaced as a whole when it changes (copy on write).
+ * Emitters load the current list atomically and call it without holding any lock, so callbacks may subscribe
+ * or unsubscribe and emitting never waits for a concurrent subscribe.
+ *
+ * With a dispatcher set, values emitted on other threads are copied into a pending queue of the source and
+ * delivered on the dispatch thread, the emitting thread never waits for the GIL then. The source only has one
+ * flush scheduled on the dispatcher at a time, so a busy source cannot crowd out the others, and its
+ * BackpressurePolicy decides what happens once capacity values are pending. completed() is never dropped, and
+ * CoalesceLatest only replaces a pending value, never an error or completed() queued before it.
+ *
+ * A throttle drops values before any of that happens, for telemetry that changes with every frame. With a
+ * dispatcher, the latest value that came too soon is delivered once the interval expired (trailing edge).
+ *
+ * Native subscribers get every value as const T & on the emitting thread, before throttling and dispatching,
+ * without the GIL or a conversion to Python. They must not block and must not call into Python.
+ *
+ * Every subscription counts the calls of its callbacks in flight. unsubscribe() waits for the ones running on
+ * other threads, so once it returned the callbacks are not running anymore and will not be called again. A
+ * callback may unsubscribe itself, it is not waited for then.
+ */
 template <typename T>
 class EventSource
 {
@@ -29,27 +102,85 @@ public:
         std::function<void(const py::object &)> on_next;
         std::function<void(const int32_t, const std::string &)> on_error;
         std::function<void()> on_completed;
-        bool active = true;
-        EventSource<T> *parent = nullptr;
+        std::function<void(const T &)> on_native_next;
+        std::atomic<bool> active{true};
+        std::atomic<EventSource<T> *> parent{nullptr};
+        std::atomic<size_t> in_flight{0};
 
         void unsubscribe()
         {
             active = false;
 
-            if (parent)
+            EventSource<T> *source = parent.exchange(nullptr);
+            if (source)
             {
-                parent->cleanup_subscribers();
+                source->cleanup_subscribers();
+            }
+            wait_for_calls();
+        }
+
+        // Runs f unless unsubscribed, emitters call every callback through it
+        template <typename F>
+        void call(F &&f)
+        {
+            // Sequentially consistent with active, either this sees it cleared or unsubscribe() sees the call
+            in_flight.fetch_add(1);
+            struct Done
+            {
+                std::atomic<size_t> &count;
+                ~Done() { count.fetch_sub(1, std::memory_order_release); }
+            } done{in_flight};
+            if (!active.load())
+                return;
+            SubscriptionCall running(this);
+            f();
+        }
+
+    private:
+        void wait_for_calls() const
+        {
+            // A callback unsubscribing itself would wait for itself
+            if (!in_flight.load() || SubscriptionCall::IsRunning(this))
+                return;
+            // A Python callback in flight needs the GIL to finish
+            if (PyGILState_Check())
+            {
+                py::gil_scoped_release release;
+                wait_idle();
+            }
+            else
+                wait_idle();
+        }
+
+        void wait_idle() const
+        {
+            for (int spins = 0; in_flight.load(std::memory_order_acquire); spins++)
+            {
+                if (spins < 64)
+                    std::this_thread::yield();
+                else
+                    std::this_thread::sleep_for(std::chrono::microseconds(100));
             }
         }
     };
 
+    typedef std::vector<std::shared_ptr<Subscription>> SubscriberList;
+    typedef typename std::decay<T>::type Value;
+
     std::function<void()> on_subscribe;
 
-    EventSource() { }
+    EventSource()
+        : subscribers(std::make_shared<const SubscriberList>()),
+          native_subscribers(std::make_shared<const SubscriberList>()) { }
 
+    // The dispatcher is not copied, it may not outlive the original
     EventSource(const EventSource &other)
+        : policy(other.policy), capacity(other.capacity), block_timeout(other.block_timeout),
+          throttle_interval(other.throttle_interval), throttle_min_delta(other.throttle_min_delta)
     {
-        subscribers = other.subscribers; // Deep copy subscriber list
+        throttle_enabled = other.throttle_enabled.load();
+        subscribers = std::atomic_load(&other.subscribers); // Snapshots are immutable, so they can be shared
+        native_subscribers = std::atomic_load(&other.native_subscribers);
     }
 
     // Copy Assignment Operator
@@ -60,13 +191,30 @@ public:
             return *this;
         }
         std::lock_guard<std::mutex> lock(subscribers_mutex);
-        subscribers = other.subscribers;
+        std::atomic_store(&subscribers, std::atomic_load(&other.subscribers));
+        std::atomic_store(&native_subscribers, std::atomic_load(&other.native_subscribers));
+        policy = other.policy;
+        capacity = other.capacity;
+        block_timeout = other.block_timeout;
+        std::lock_guard<std::mutex> throttle_lock(throttle_mutex);
+        throttle_interval = other.throttle_interval;
+        throttle_min_delta = other.throttle_min_delta;
+        throttle_enabled = other.throttle_enabled.load();
         return *this;
     }
 
     ~EventSource()
     {
-        // std::cout << "EventSource destroyed at " << this << std::endl;
+        // Subscriptions may outlive the source in Python, they must not call back into it
+        for (auto *list : {&subscribers, &native_subscribers})
+        {
+            auto snapshot = std::atomic_load(list);
+            for (auto &sub : *snapshot)
+            {
+                EventSource<T> *self = this;
+                sub->parent.compare_exchange_strong(self, nullptr);
+            }
+        }
     }
 
     void set_on_subscribe(std::function<void()> on_subscribe)
@@ -74,58 +222,173 @@ public:
         this->on_subscribe = on_subscribe;
     }
 
+    /**
+     * Must be set before the first value is emitted, the dispatcher must be stopped before the source is destroyed.
+     */
+    void set_dispatcher(EventDispatcher *dispatcher)
+    {
+        this->dispatcher = dispatcher;
+    }
+
+    /**
+     * @param capacity number of values waiting for the dispatch thread before the policy applies, at least 1
+     * @param timeout seconds Block waits for room before dropping the value, 0 or less waits until there is room
+     */
+    void set_policy(BackpressurePolicy policy, size_t capacity, double timeout)
+    {
+        std::lock_guard<std::mutex> lock(pending_mutex);
+        this->policy = policy;
+        this->capacity = std::max<size_t>(1, capacity);
+        block_timeout = std::chrono::duration<double>(std::max(0.0, timeout));
+        pending_cond.notify_all();
+    }
+
+    BackpressurePolicy get_policy() const
+    {
+        std::lock_guard<std::mutex> lock(pending_mutex);
+        return policy;
+    }
+
+    size_t get_pending_count() const
+    {
+        std::lock_guard<std::mutex> lock(pending_mutex);
+        return pending.size();
+    }
+
+    uint64_t get_dropped_count() const { return dropped.load(std::memory_order_relaxed); }
+    uint64_t get_coalesced_count() const { return coalesced.load(std::memory_order_relaxed); }
+
+    /**
+     * Drops values emitted less than 1 / max_hz seconds after the last one that went through, or, for numeric
+     * values, differing by less than min_delta from it. With a dispatcher, the latest value that came too soon
+     * is delivered when the interval expired, unless it is within min_delta of the last one by then.
+     * @param max_hz 0 disables the rate limit
+     * @param min_delta 0 disables the delta check
+     */
+    void set_throttle(double max_hz, double min_delta)
+    {
+        std::lock_guard<std::mutex> lock(throttle_mutex);
+        throttle_interval = std::chrono::duration<double>(max_hz > 0.0 ? 1.0 / max_hz : 0.0);
+        throttle_min_delta = std::max(0.0, min_delta);
+        throttle_has_last = false;
+        throttle_trailing = nullptr;
+        throttle_enabled = max_hz > 0.0 || min_delta > 0.0;
+    }
+
+    uint64_t get_throttled_count() const { return throttled.load(std::memory_order_relaxed); }
+
+    // Does not need the GIL, so emitters can skip building the event for nobody
+    bool has_subscribers() const
+    {
+        return has_active(native_subscribers) || has_active(subscribers);
+    }
+
+    bool has_python_subscribers() const
+    {
+        return has_active(subscribers);
+    }
+
     void next(const T &value) const
     {
-        py::gil_scoped_acquire gil;
-        std::lock_guard<std::mutex> lock(subscribers_mutex);
-        for (auto &sub : subscribers)
+        auto natives = std::atomic_load(&native_subscribers);
+        for (auto &sub : *natives)
+        {
+            if (sub->on_native_next)
+                sub->call([&]()
+                          { sub->on_native_next(value); });
+        }
+
+        if (std::atomic_load(&subscribers)->empty())
+            return;
+        if (throttle_enabled.load(std::memory_order_relaxed) &&
+            !pass_throttle(numeric_value(value), [this, &value]() -> EventDispatcher::Event
+                           {
+                Value copy(value);
+                return [this, copy]() { emit_next(copy); }; }))
+        {
+            return;
+        }
+
+        if (Dispatched())
         {
-            if (sub.active && sub.on_next)
-                sub.on_next(py::cast(value));
+            Value copy(value);
+            enqueue([this, copy]()
+                    { emit_next(copy); }, PendingKind::Next);
+            return;
         }
+        emit_next(value);
     }
 
     void next() const
     {
-        py::gil_scoped_acquire gil;
-        std::lock_guard<std::mutex> lock(subscribers_mutex);
-        for (auto &sub : subscribers)
+        if (std::atomic_load(&subscribers)->empty())
+            return;
+        if (throttle_enabled.load(std::memory_order_relaxed) &&
+            !pass_throttle(0.0, [this]() -> EventDispatcher::Event
+                           { return [this]() { emit_next(); }; }))
         {
-            if (sub.active && sub.on_next)
-                sub.on_next(py::none());
+            return;
         }
+
+        if (Dispatched())
+        {
+            enqueue([this]()
+                    { emit_next(); }, PendingKind::Next);
+            return;
+        }
+        emit_next();
     }
 
     void error(const int code, const std::string &message) const
     {
-        py::gil_scoped_acquire gil;
-        std::lock_guard<std::mutex> lock(subscribers_mutex);
+        auto natives = std::atomic_load(&native_subscribers);
+        for (auto &sub : *natives)
+        {
+            if (sub->on_error)
+                sub->call([&]()
+                          { sub->on_error(code, message); });
+        }
 
-        for (auto &sub : subscribers)
+        if (std::atomic_load(&subscribers)->empty())
+            return;
+
+        if (Dispatched())
         {
-            if (sub.active && sub.on_error)
-            {
-                sub.on_error(code, message);
-            }
+            enqueue([this, code, message]()
+                    { emit_error(code, message); }, PendingKind::Error);
+            return;
         }
+        emit_error(code, message);
     }
 
     void completed()
     {
         has_completed = true;
-        py::gil_scoped_acquire gil;
-        std::lock_guard<std::mutex> lock(subscribers_mutex);
-        for (auto &sub : subscribers)
+        std::shared_ptr<const SubscriberList> natives;
         {
-            if (sub.active && sub.on_completed)
-            {
-                sub.on_completed();
-            }
+            std::lock_guard<std::mutex> lock(subscribers_mutex);
+            natives = std::atomic_load(&native_subscribers);
+            std::atomic_store(&native_subscribers, std::make_shared<const SubscriberList>());
         }
-        subscribers.clear();
+        for (auto &sub : *natives)
+        {
+            sub->parent = nullptr;
+            if (sub->on_completed)
+                sub->call([&]()
+                          { sub->on_completed(); });
+        }
+
+        // Queued values are still delivered before the subscribers are let go
+        if (Dispatched())
+        {
+            enqueue([this]()
+                    { emit_completed(); }, PendingKind::Completed);
+            return;
+        }
+        emit_completed();
     }
 
-    Subscription &subscribe(
+    std::shared_ptr<Subscription> subscribe(
         std::function<void(const py::object &)> on_next,
         std::function<void(const int32_t, const std::string &)> on_error = py::none(),
         std::function<void()> on_completed = py::none())
@@ -135,34 +398,379 @@ public:
         {
             throw std::runtime_error("Cannot subscribe to a completed EventSource");
         }
+
+        auto sub = std::make_shared<Subscription>();
+        sub->on_next = on_next;
+        sub->on_error = on_error;
+        sub->on_completed = on_completed;
+        sub->parent = this;
+
+        bool first = false;
+        {
+            std::lock_guard<std::mutex> lock(subscribers_mutex);
+            auto updated = std::make_shared<SubscriberList>(*std::atomic_load(&subscribers));
+            updated->push_back(sub);
+            std::atomic_store(&subscribers, std::shared_ptr<const SubscriberList>(std::move(updated)));
+            first = !has_started.exchange(true);
+        }
+
+        // Called without the lock, so it may emit or subscribe right away
+        if (first && on_subscribe)
+        {
+            on_subscribe();
+        }
+        return sub;
+    }
+
+    /**
+     * Subscribes C++ code, the callbacks run on the emitting thread without the GIL.
+     * next() without a value is not passed on, on_error and on_completed are optional.
+     */
+    std::shared_ptr<Subscription> subscribe_native(
+        std::function<void(const T &)> on_next,
+        std::function<void(const int32_t, const std::string &)> on_error = nullptr,
+        std::function<void()> on_completed = nullptr)
+    {
+        if (has_completed)
+        {
+            throw std::runtime_error("Cannot subscribe to a completed EventSource");
+        }
+
+        auto sub = std::make_shared<Subscription>();
+        sub->on_native_next = on_next;
+        sub->on_error = on_error;
+        sub->on_completed = on_completed;
+        sub->parent = this;
+
         std::lock_guard<std::mutex> lock(subscribers_mutex);
-        subscribers.push_back(Subscription{on_next, on_error, on_completed, true, this});
-        if (!has_started)
+        auto updated = std::make_shared<SubscriberList>(*std::atomic_load(&native_subscribers));
+        updated->push_back(sub);
+        std::atomic_store(&native_subscribers, std::shared_ptr<const SubscriberList>(std::move(updated)));
+        return sub;
+    }
+
+private:
+    EventDispatcher *dispatcher = nullptr;
+    /** Only replaced under subscribers_mutex, read by emitters without it */
+    std::shared_ptr<const SubscriberList> subscribers;
+    std::shared_ptr<const SubscriberList> native_subscribers;
+    mutable std::mutex subscribers_mutex;
+    std::atomic<bool> has_started{false};
+    std::atomic<bool> has_completed{false};
+
+    enum class PendingKind
+    {
+        Next,
+        Error,
+        Completed, // never dropped or replaced
+    };
+
+    struct PendingEvent
+    {
+        EventDispatcher::Event event;
+        PendingKind kind;
+    };
+
+    /** Values waiting for the dispatch thread, guarded by pending_mutex like the policy */
+    mutable std::deque<PendingEvent> pending;
+    mutable bool flush_scheduled = false;
+    mutable std::mutex pending_mutex;
+    mutable std::condition_variable pending_cond;
+    BackpressurePolicy policy = BackpressurePolicy::DropOldest;
+    size_t capacity = 256;
+    std::chrono::duration<double> block_timeout{1.0};
+    mutable std::atomic<uint64_t> dropped{0};
+    mutable std::atomic<uint64_t> coalesced{0};
+
+    mutable std::mutex throttle_mutex;
+    std::atomic<bool> throttle_enabled{false};
+    std::chrono::duration<double> throttle_interval{0.0};
+    double throttle_min_delta = 0.0;
+    mutable std::chrono::steady_clock::time_point throttle_last_time;
+    mutable double throttle_last_value = 0.0;
+    mutable bool throttle_has_last = false;
+    /** Latest value that came too soon, delivered by flush_throttle() */
+    mutable EventDispatcher::Event throttle_trailing;
+    mutable double throttle_trailing_value = 0.0;
+    mutable bool throttle_trailing_scheduled = false;
+    mutable std::atomic<uint64_t> throttled{0};
+
+    static double numeric_value(const T &value)
+    {
+        if constexpr (std::is_arithmetic<Value>::value)
+            return static_cast<double>(value);
+        else
+            return 0.0;
+    }
+
+    bool too_close(double value) const
+    {
+        return std::is_arithmetic<Value>::value && throttle_min_delta > 0.0 &&
+               std::abs(value - throttle_last_value) < throttle_min_delta;
+    }
+
+    // The delta check only applies to numeric values, make_trailing is only called for a value that came too soon
+    template <typename F>
+    bool pass_throttle(double value, F &&make_trailing) const
+    {
+        auto now = std::chrono::steady_clock::now();
+        std::lock_guard<std::mutex> lock(throttle_mutex);
+        if (throttle_has_last)
         {
-            has_started = true;
-            if (on_subscribe)
+            bool too_soon = throttle_interval.count() > 0.0 && now - throttle_last_time < throttle_interval;
+            if (too_soon && dispatcher)
             {
-                on_subscribe();
+                if (throttle_trailing)
+                    throttled++;
+                throttle_trailing = make_trailing();
+                throttle_trailing_value = value;
+                if (!throttle_trailing_scheduled)
+                {
+                    auto due = throttle_last_time + std::chrono::duration_cast<std::chrono::steady_clock::duration>(throttle_interval);
+                    throttle_trailing_scheduled = dispatcher->PostAt([this]()
+                                                                     { flush_throttle(); }, due);
+                    if (!throttle_trailing_scheduled)
+                    {
+                        throttle_trailing = nullptr;
+                        throttled++;
+                    }
+                }
+                return false;
             }
+            if (too_soon || too_close(value))
+            {
+                throttled++;
+                return false;
+            }
+        }
+        // A value that passes is newer than the trailing one
+        if (throttle_trailing)
+        {
+            throttle_trailing = nullptr;
+            throttled++;
         }
-        return subscribers.back();
+        throttle_last_time = now;
+        throttle_last_value = value;
+        throttle_has_last = true;
+        return true;
     }
 
-private:
-    mutable std::mutex subscribers_mutex;
-    std::vector<Subscription> subscribers;
-    bool has_started = false;
-    bool has_completed = false;
+    // Runs on the dispatch thread once the interval of the last value that went through expired
+    void flush_throttle() const
+    {
+        EventDispatcher::Event trailing;
+        {
+            std::lock_guard<std::mutex> lock(throttle_mutex);
+            throttle_trailing_scheduled = false;
+            if (!throttle_trailing)
+                return;
+            trailing = std::move(throttle_trailing);
+            throttle_trailing = nullptr;
+            if (too_close(throttle_trailing_value))
+            {
+                throttled++;
+                return;
+            }
+            throttle_last_time = std::chrono::steady_clock::now();
+            throttle_last_value = throttle_trailing_value;
+            throttle_has_last = true;
+        }
+        // Queued behind the values still pending, so the trailing one is delivered last
+        enqueue(std::move(trailing), PendingKind::Next);
+    }
 
-    void cleanup_subscribers()
+    bool Dispatched() const
+    {
+        return dispatcher && !dispatcher->IsDispatchThread();
+    }
+
+    void enqueue(EventDispatcher::Event event, PendingKind kind) const
+    {
+        std::unique_lock<std::mutex> lock(pending_mutex);
+        if (kind != PendingKind::Completed && pending.size() >= capacity)
+        {
+            switch (policy)
+            {
+            case BackpressurePolicy::DropOldest:
+            {
+                auto oldest = std::find_if(pending.begin(), pending.end(), [](const PendingEvent &entry)
+                                           { return entry.kind != PendingKind::Completed; });
+                if (oldest != pending.end())
+                {
+                    pending.erase(oldest);
+                    dropped++;
+                }
+                break;
+            }
+            case BackpressurePolicy::DropNewest:
+                dropped++;
+                return;
+            case BackpressurePolicy::CoalesceLatest:
+                break;
+            case BackpressurePolicy::Block:
+                // The dispatch thread needs the GIL to make room, so a thread holding it queues beyond capacity
+                if (!PyGILState_Check() && !wait_for_room(lock))
+                {
+                    dropped++;
+                    return;
+                }
+                break;
+            }
+        }
+        // Only a value replaces a value, an error or completed() stays queued in front of it
+        if (kind == PendingKind::Next && policy == BackpressurePolicy::CoalesceLatest && !pending.empty() &&
+            pending.back().kind == PendingKind::Next)
+        {
+            pending.back().event = std::move(event);
+            coalesced++;
+            return;
+        }
+
+        pending.push_back({std::move(event), kind});
+        if (flush_scheduled)
+            return;
+        flush_scheduled = true;
+        lock.unlock();
+
+        if (!dispatcher->Post([this]()
+                              { flush(); }))
+        {
+            // The dispatcher stopped, nothing is going to deliver the values anymore, completed() is kept
+            lock.lock();
+            auto terminal = std::stable_partition(pending.begin(), pending.end(), [](const PendingEvent &entry)
+                                                  { return entry.kind == PendingKind::Completed; });
+            dropped += std::distance(terminal, pending.end());
+            pending.erase(terminal, pending.end());
+            flush_scheduled = false;
+            pending_cond.notify_all();
+        }
+    }
+
+    bool wait_for_room(std::unique_lock<std::mutex> &lock) const
     {
+        auto room = [this]()
+        { return pending.size() < capacity || policy != BackpressurePolicy::Block || dispatcher->IsStopping(); };
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::duration_cast<std::chrono::steady_clock::duration>(block_timeout);
+        bool forever = block_timeout.count() <= 0.0;
+        // Waits in slices, a dispatcher that stopped does not wake anyone
+        while (!room())
+        {
+            auto now = std::chrono::steady_clock::now();
+            if (!forever && now >= deadline)
+                return false;
+            auto slice = now + std::chrono::milliseconds(100);
+            pending_cond.wait_until(lock, forever ? slice : std::min(slice, deadline));
+        }
+        return true;
+    }
+
+    // Runs on the dispatch thread with the GIL held
+    void flush() const
+    {
+        std::deque<PendingEvent> events;
+        {
+            std::lock_guard<std::mutex> lock(pending_mutex);
+            events.swap(pending);
+            flush_scheduled = false;
+        }
+        pending_cond.notify_all();
+        for (auto &entry : events)
+        {
+            // A callback that destroyed the owner of the source took the source with it
+            if (EventDispatcher::IsCurrentDetached())
+                return;
+            EventDispatcher::Invoke(entry.event);
+        }
+    }
+
+    void emit_next(const T &value) const
+    {
+        auto snapshot = std::atomic_load(&subscribers);
+        if (snapshot->empty())
+            return;
+
         py::gil_scoped_acquire gil;
+        py::object object = py::cast(value);
+        for (auto &sub : *snapshot)
+        {
+            if (sub->on_next)
+                sub->call([&]()
+                          { sub->on_next(object); });
+        }
+    }
+
+    void emit_next() const
+    {
+        auto snapshot = std::atomic_load(&subscribers);
+        if (snapshot->empty())
+            return;
+
+        py::gil_scoped_acquire gil;
+        for (auto &sub : *snapshot)
+        {
+            if (sub->on_next)
+                sub->call([&]()
+                          { sub->on_next(py::none()); });
+        }
+    }
+
+    void emit_error(const int code, const std::string &message) const
+    {
+        auto snapshot = std::atomic_load(&subscribers);
+        if (snapshot->empty())
+            return;
+
+        py::gil_scoped_acquire gil;
+        for (auto &sub : *snapshot)
+        {
+            if (sub->on_error)
+            {
+                sub->call([&]()
+                          { sub->on_error(code, message); });
+            }
+        }
+    }
+
+    void emit_completed()
+    {
+        std::shared_ptr<const SubscriberList> snapshot;
+        {
+            std::lock_guard<std::mutex> lock(subscribers_mutex);
+            snapshot = std::atomic_load(&subscribers);
+            std::atomic_store(&subscribers, std::make_shared<const SubscriberList>());
+        }
+
+        py::gil_scoped_acquire gil;
+        for (auto &sub : *snapshot)
+        {
+            sub->parent = nullptr;
+            if (sub->on_completed)
+            {
+                sub->call([&]()
+                          { sub->on_completed(); });
+            }
+        }
+    }
+
+    static bool has_active(const std::shared_ptr<const SubscriberList> &list)
+    {
+        auto snapshot = std::atomic_load(&list);
+        return std::any_of(snapshot->begin(), snapshot->end(), [](const std::shared_ptr<Subscription> &sub)
+                           { return sub->active.load(); });
+    }
+
+    void cleanup_subscribers()
+    {
         std::lock_guard<std::mutex> lock(subscribers_mutex);
-        subscribers.erase(
-            std::remove_if(subscribers.begin(), subscribers.end(),
-                           [](const Subscription &sub)
-                           { return !sub.active; }),
-            subscribers.end());
+        for (auto *list : {&subscribers, &native_subscribers})
+        {
+            auto current = std::atomic_load(list);
+            auto updated = std::make_shared<SubscriberList>();
+            updated->reserve(current->size());
+            std::copy_if(current->begin(), current->end(), std::back_inserter(*updated), [](const std::shared_ptr<Subscription> &sub)
+                         { return sub->active.load(); });
+            std::atomic_store(list, std::shared_ptr<const SubscriberList>(std::move(updated)));
+        }
     }
 };
 
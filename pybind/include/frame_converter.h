@@ -0,0 +1,155 @@
+#ifndef CHIAKI_PY_FRAME_CONVERTER_H
+#define CHIAKI_PY_FRAME_CONVERTER_H
+
+#include "conversion_backend.h"
+#include "worker_pool.h"
+#include "yuv_kernels.h"
+
+#include <vector>
+#include <memory>
+#include <cstddef>
+#include <mutex>
+
+extern "C"
+{
+#include <libavutil/frame.h>
+#include <libavutil/pixfmt.h>
+#include <libswscale/swscale.h>
+}
+
+/**
+ * Pixel formats frames can be read in.
+ */
+enum class FrameFormat
+{
+    RGB24,
+    BGR24,
+    RGBA,
+    BGRA,
+    /** Luma only, copied from the Y plane of YUV frames without conversion (keeps the stream's range) */
+    GRAY8,
+    /** Raw planar layouts, Y plane followed by the chroma plane(s) */
+    NV12,
+    YUV420P
+};
+
+AVPixelFormat GetFramePixelFormat(FrameFormat format);
+
+/**
+ * Per-session frame conversion state.
+ *
+ * Keeps the SwsContext, the hardware download frame and a small pool of destination frames alive
+ * between calls, so the per-frame path only allocates again when the stream geometry or the
+ * requested pixel format changes.
+ *
+ * With more than one conversion thread, frames are split into horizontal slices that are converted
+ * in parallel, each with its own scaler.
+ *
+ * Both backends honour the colorspace and range the frame is tagged with. Resizing always goes
+ * through a single libswscale pass that also converts the pixel format.
+ *
+ * The converter is shared by every thread reading frames from the session: hold Lock() for as long as
+ * a frame returned by it is in use.
+ */
+class FrameConverter
+{
+public:
+    explicit FrameConverter(size_t pool_size = 3);
+    ~FrameConverter();
+
+    FrameConverter(const FrameConverter &) = delete;
+    FrameConverter &operator=(const FrameConverter &) = delete;
+
+    /**
+     * @param thread_count number of threads converting a frame, 0 for one per CPU core
+     */
+    void SetThreadCount(unsigned int thread_count);
+    unsigned int GetThreadCount() const { return workers ? workers->GetThreadCount() : 1; }
+    /**
+     * Converts with the worker threads of other instead of threads of its own.
+     * Conversions of both converters then take turns on the pool.
+     */
+    void ShareWorkers(FrameConverter &other);
+
+    void SetBackend(ConversionBackend backend);
+    ConversionBackend GetBackend() const { return backend; }
+
+    std::unique_lock<std::mutex> Lock() { return std::unique_lock<std::mutex>(mutex); }
+
+    /**
+     * Downloads a hardware frame into system memory.
+     * Frames that are already in system memory are returned unchanged.
+     * @return the software frame (owned by the converter, valid until the next call) or nullptr on failure
+     */
+    AVFrame *TransferHardwareFrame(AVFrame *frame);
+
+    /**
+     * Crops frame to the given rectangle without copying.
+     * x and y are rounded down to the chroma grid of subsampled formats.
+     * @return a view on frame (owned by the converter, valid until the next call) or nullptr if the rectangle is out of bounds
+     */
+    AVFrame *Crop(const AVFrame *frame, int x, int y, int width, int height);
+
+    /**
+     * Converts frame to dst_format using the cached scaler.
+     * @return a frame from the destination pool (owned by the converter, valid for the next pool_size - 1 conversions) or nullptr on failure
+     */
+    AVFrame *Convert(const AVFrame *frame, AVPixelFormat dst_format);
+
+    /**
+     * Converts and resizes frame to dst_format and dst_width x dst_height straight into a caller-owned buffer, skipping the pool frame.
+     * The image is laid out like av_image_copy_to_buffer() with an alignment of 1.
+     * @return false if buffer is too small or the conversion failed
+     */
+    bool ConvertToBuffer(const AVFrame *frame, AVPixelFormat dst_format, int dst_width, int dst_height, uint8_t *buffer, size_t buffer_size);
+
+    /**
+     * Drops the cached scaler and all pooled frames.
+     */
+    void Reset();
+
+private:
+    std::mutex mutex;
+
+    struct ScalerKey
+    {
+        int width;
+        int height;
+        AVPixelFormat src_format;
+        int dst_width;
+        int dst_height;
+        AVPixelFormat dst_format;
+        YuvColorMatrix matrix;
+        bool full_range;
+
+        bool operator==(const ScalerKey &other) const
+        {
+            return width == other.width && height == other.height && src_format == other.src_format &&
+                   dst_width == other.dst_width && dst_height == other.dst_height && dst_format == other.dst_format &&
+                   matrix == other.matrix && full_range == other.full_range;
+        }
+    };
+
+    struct CachedScaler
+    {
+        ScalerKey key;
+        SwsContext *ctx;
+    };
+
+    // One scaler per slice, index 0 is also used for whole frames
+    std::vector<CachedScaler> scalers;
+    std::shared_ptr<WorkerPool> workers;
+    ConversionBackend backend;
+    AVFrame *sw_frame;
+    AVFrame *crop_frame;
+    std::vector<AVFrame *> frame_pool;
+    size_t frame_pool_next;
+
+    SwsContext *GetScaler(const ScalerKey &key, size_t slot);
+    bool Scale(const AVFrame *src, uint8_t *const dst_data[4], const int dst_linesize[4], AVPixelFormat dst_format, int dst_width, int dst_height);
+    bool ConvertNative(const AVFrame *src, uint8_t *const dst_data[4], const int dst_linesize[4], AVPixelFormat dst_format);
+    int SliceCount(int height) const;
+    AVFrame *NextPoolFrame(int width, int height, AVPixelFormat format);
+};
+
+#endif // CHIAKI_PY_FRAME_CONVERTER_H
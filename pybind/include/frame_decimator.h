@@ -0,0 +1,112 @@
+#ifndef CHIAKI_PY_FRAME_DECIMATOR_H
+#define CHIAKI_PY_FRAME_DECIMATOR_H
+
+#include "frame_hash.h"
+
+#include <atomic>
+#include <cstdint>
+
+/**
+ * Selects which decoded frames are delivered to readers.
+ *
+ * The decoder still decodes every frame, since later frames reference earlier ones, but frames that are not
+ * selected are neither published, converted nor announced. Settings can be changed from any thread while
+ * Select() is called by the decoder thread.
+ *
+ * With duplicate suppression, frames whose hash is within a Hamming distance of the last delivered frame's
+ * hash are skipped before the rate limits are applied, so static screens do not use up delivery slots.
+ */
+class FrameDecimator
+{
+public:
+    FrameDecimator()
+        : every_nth_frame(1), interval_ns(0), duplicate_distance(-1), skipped(0), duplicates(0),
+          counter(0), next_ns(0), has_last_hash(false), last_hash(0)
+    {
+    }
+
+    /**
+     * Only deliver every n-th decoded frame, 0 and 1 deliver all of them.
+     */
+    void SetEveryNthFrame(uint32_t n) { every_nth_frame.store(n ? n : 1, std::memory_order_relaxed); }
+    uint32_t GetEveryNthFrame() const { return every_nth_frame.load(std::memory_order_relaxed); }
+
+    /**
+     * Deliver at most fps frames per second, 0 disables the limit.
+     */
+    void SetMaxFps(double fps) { interval_ns.store(fps > 0 ? (int64_t)(1e9 / fps) : 0, std::memory_order_relaxed); }
+    double GetMaxFps() const
+    {
+        int64_t interval = interval_ns.load(std::memory_order_relaxed);
+        return interval > 0 ? 1e9 / (double)interval : 0.0;
+    }
+
+    /**
+     * Skip frames whose hash differs from the last delivered one in at most max_distance bits, a negative
+     * distance disables suppression.
+     */
+    void SetDuplicateDistance(int max_distance) { duplicate_distance.store(max_distance, std::memory_order_relaxed); }
+    int GetDuplicateDistance() const { return duplicate_distance.load(std::memory_order_relaxed); }
+    bool GetSuppressDuplicates() const { return GetDuplicateDistance() >= 0; }
+
+    /**
+     * @return the number of decoded frames that were not delivered, including duplicates
+     */
+    uint64_t GetSkippedCount() const { return skipped.load(std::memory_order_relaxed); }
+    uint64_t GetDuplicateCount() const { return duplicates.load(std::memory_order_relaxed); }
+
+    /**
+     * Decides whether the frame decoded at now_ns is delivered. Called by the decoder thread only.
+     * @param hash hash of the frame, or nullptr if it was not computed
+     */
+    bool Select(int64_t now_ns, const uint64_t *hash)
+    {
+        int distance = duplicate_distance.load(std::memory_order_relaxed);
+        if (distance >= 0 && hash && has_last_hash && GetFrameHashDistance(*hash, last_hash) <= distance)
+        {
+            duplicates.fetch_add(1, std::memory_order_relaxed);
+            skipped.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+
+        uint32_t n = every_nth_frame.load(std::memory_order_relaxed);
+        if (n > 1 && (counter++ % n) != 0)
+        {
+            skipped.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+
+        int64_t interval = interval_ns.load(std::memory_order_relaxed);
+        if (interval > 0)
+        {
+            if (now_ns < next_ns)
+            {
+                skipped.fetch_add(1, std::memory_order_relaxed);
+                return false;
+            }
+            // Scheduled from the previous deadline so late frames do not lower the rate,
+            // but restarted after a stall instead of delivering a burst to catch up
+            next_ns += interval;
+            if (next_ns <= now_ns)
+                next_ns = now_ns + interval;
+        }
+
+        has_last_hash = hash != nullptr;
+        if (hash)
+            last_hash = *hash;
+        return true;
+    }
+
+private:
+    std::atomic<uint32_t> every_nth_frame;
+    std::atomic<int64_t> interval_ns;
+    std::atomic<int> duplicate_distance;
+    std::atomic<uint64_t> skipped;
+    std::atomic<uint64_t> duplicates;
+    uint64_t counter;
+    int64_t next_ns;
+    bool has_last_hash;
+    uint64_t last_hash;
+};
+
+#endif // CHIAKI_PY_FRAME_DECIMATOR_H
@@ -0,0 +1,45 @@
+#ifndef CHIAKI_PY_FRAME_HASH_H
+#define CHIAKI_PY_FRAME_HASH_H
+
+#include "luma_plane.h"
+
+#include <cstdint>
+
+extern "C"
+{
+#include <libavutil/frame.h>
+}
+
+/**
+ * 64 bit difference hash (dHash) of the luma plane: the frame is reduced to 9x8 cell averages and every bit
+ * tells whether a cell is darker than its right neighbour. Similar frames have hashes with a small Hamming
+ * distance, re-encoded copies of the same image usually hash identically.
+ */
+uint64_t ComputeFrameHash(const LumaPlane &plane);
+
+inline int GetFrameHashDistance(uint64_t a, uint64_t b)
+{
+    uint64_t x = a ^ b;
+    int count = 0;
+    while (x)
+    {
+        x &= x - 1;
+        count++;
+    }
+    return count;
+}
+
+/**
+ * Hashes decoded frames on the decoder thread. Hardware frames are downloaded by the caller, once for every
+ * consumer of the frame.
+ */
+class FrameHasher
+{
+public:
+    /**
+     * @return false if no hash was computed, e.g. for hardware frames
+     */
+    bool Compute(const AVFrame *frame, uint64_t *hash);
+};
+
+#endif // CHIAKI_PY_FRAME_HASH_H
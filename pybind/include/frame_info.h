@@ -0,0 +1,100 @@
+#ifndef CHIAKI_PY_FRAME_INFO_H
+#define CHIAKI_PY_FRAME_INFO_H
+
+#include "exception.h"
+
+#include <chrono>
+#include <cstdint>
+
+/**
+ * @return nanoseconds on the monotonic clock all frame timestamps are taken from
+ */
+inline int64_t FrameClockNs()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/**
+ * Metadata of a frame read from the session.
+ */
+struct FrameInfo
+{
+    int64_t pts = 0;
+    /** Number of the frame since the session started, gaps mean frames were skipped because they were not read in time */
+    uint64_t sequence = 0;
+    /** Frames lost by the decoder since the previously read frame */
+    int32_t frames_lost = 0;
+    /** FrameClockNs() when the decoder handed out the frame */
+    int64_t decoded_ns = 0;
+    /** FrameClockNs() when converting or copying the frame into the target started and ended, 0 if it was not */
+    int64_t convert_start_ns = 0;
+    int64_t convert_end_ns = 0;
+    /** Perceptual hash of the frame, see ComputeFrameHash(). 0 for hardware frames unless duplicates are suppressed */
+    uint64_t hash = 0;
+};
+
+/**
+ * Outcome of reading a frame from the session.
+ */
+enum class FrameResult
+{
+    Success,
+    /** No frame was decoded since the last read, not an error */
+    NoFrame,
+    NoDecoder,
+    /** The target is not a C-contiguous array */
+    InvalidTarget,
+    TargetTooSmall,
+    /** A batch item does not have the size of the output image */
+    ShapeMismatch,
+    TransferFailed,
+    /** The region of interest is outside of the frame */
+    InvalidRegion,
+    InvalidSize,
+    ConversionFailed,
+    Count
+};
+
+inline const char *GetFrameResultMessage(FrameResult result)
+{
+    switch (result)
+    {
+    case FrameResult::Success:
+        return "Success";
+    case FrameResult::NoFrame:
+        return "No new frame available";
+    case FrameResult::NoDecoder:
+        return "Session has no FFmpeg decoder";
+    case FrameResult::InvalidTarget:
+        return "Target array must be C-contiguous";
+    case FrameResult::TargetTooSmall:
+        return "Target array is too small for the frame";
+    case FrameResult::ShapeMismatch:
+        return "Target shape does not match the frame";
+    case FrameResult::TransferFailed:
+        return "Failed to transfer frame from hardware";
+    case FrameResult::InvalidRegion:
+        return "Region of interest is outside of the frame";
+    case FrameResult::InvalidSize:
+        return "Output size must be positive";
+    case FrameResult::ConversionFailed:
+        return "Failed to convert frame to the output format";
+    default:
+        return "Unknown frame result";
+    }
+}
+
+/**
+ * Raised for failed frame reads when the caller asked for exceptions.
+ */
+class FrameError : public Exception
+{
+public:
+    explicit FrameError(FrameResult result) : Exception(GetFrameResultMessage(result)), result(result) {}
+    FrameResult GetResult() const { return result; }
+
+private:
+    FrameResult result;
+};
+
+#endif // CHIAKI_PY_FRAME_INFO_H
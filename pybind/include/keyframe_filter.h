@@ -0,0 +1,69 @@
+#ifndef CHIAKI_PY_KEYFRAME_FILTER_H
+#define CHIAKI_PY_KEYFRAME_FILTER_H
+
+#include <chiaki/bitstream.h>
+#include <chiaki/common.h>
+#include <chiaki/log.h>
+
+#include <atomic>
+#include <cstdint>
+
+/**
+ * Low power decode mode: only intra coded samples are passed to the decoder.
+ *
+ * Slice types come from chiaki_bitstream_slice() once an SPS was seen, with a fallback to the NAL unit types
+ * for IDR/IRAP pictures. An optional minimum interval limits decoding to one intra sample every few seconds.
+ * The console only sends intra samples at the start and after a loss, so once the interval passed without one,
+ * TakeKeyframeRequest() tells the session to ask for it.
+ * Recorders and sample subscribers still see every sample, only the decoder is skipped. Turning the mode off
+ * decodes the next predicted samples against missing references, so the picture may show artifacts until the
+ * next keyframe.
+ */
+class KeyframeFilter
+{
+public:
+    KeyframeFilter(ChiakiLog *log, ChiakiCodec codec);
+
+    KeyframeFilter(const KeyframeFilter &) = delete;
+    KeyframeFilter &operator=(const KeyframeFilter &) = delete;
+
+    void SetEnabled(bool enabled) { this->enabled.store(enabled, std::memory_order_relaxed); }
+    bool GetEnabled() const { return enabled.load(std::memory_order_relaxed); }
+
+    /**
+     * Decode at most one intra sample every interval_us, 0 decodes all of them.
+     */
+    void SetMinInterval(int64_t interval_us) { min_interval_us.store(interval_us, std::memory_order_relaxed); }
+    int64_t GetMinInterval() const { return min_interval_us.load(std::memory_order_relaxed); }
+
+    uint64_t GetDroppedCount() const { return dropped.load(std::memory_order_relaxed); }
+    uint64_t GetKeyframeRequestCount() const { return requested.load(std::memory_order_relaxed); }
+
+    /**
+     * Decides whether a sample is decoded. Called on the receive thread only.
+     */
+    bool Select(uint8_t *buf, size_t buf_size, int64_t now_us);
+
+    /**
+     * @return true at most once per minimum interval while no intra sample was decoded for that long.
+     * Called on the receive thread only.
+     */
+    bool TakeKeyframeRequest(int64_t now_us);
+
+private:
+    ChiakiBitstream bitstream;
+    bool hevc;
+    bool has_header;
+    int64_t last_decoded_us;
+    int64_t last_request_us;
+
+    std::atomic<bool> enabled;
+    std::atomic<int64_t> min_interval_us;
+    std::atomic<uint64_t> dropped;
+    std::atomic<uint64_t> requested;
+
+    void UpdateHeader(uint8_t *buf, size_t buf_size);
+    bool IsIntra(uint8_t *buf, size_t buf_size);
+};
+
+#endif // CHIAKI_PY_KEYFRAME_FILTER_H
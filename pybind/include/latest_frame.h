@@ -0,0 +1,137 @@
+#ifndef CHIAKI_PY_LATEST_FRAME_H
+#define CHIAKI_PY_LATEST_FRAME_H
+
+#include "frame_info.h"
+
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <cstdint>
+
+extern "C"
+{
+#include <libavutil/frame.h>
+}
+
+/**
+ * Triple-buffered slot holding the most recently decoded frame.
+ *
+ * The decoder thread publishes every frame without ever waiting for readers, readers pick up the newest
+ * frame at their own pace. Frames that were overwritten before anyone read them are dropped (latest wins),
+ * the decoder losses reported with them are added to the next frame that is read.
+ *
+ * There is a single writer. Readers must hold Lock() from Acquire() until they are done with the frame.
+ */
+class LatestFrameSlot
+{
+public:
+    struct Entry
+    {
+        AVFrame *frame;
+        /** Number of the frame since the session started, counting dropped frames */
+        uint64_t sequence;
+        /** Frames lost by the decoder since the previously read frame, not counting frames dropped by the slot */
+        int32_t frames_lost;
+        /** FrameClockNs() when the frame was published */
+        int64_t decoded_ns;
+        /** ComputeFrameHash() of the frame, 0 if it was not computed */
+        uint64_t hash;
+    };
+
+    LatestFrameSlot() : write_index(0), read_index(1), shared(2), published(0), pending_frames_lost(0), waiters(0)
+    {
+        for (auto &entry : entries)
+            entry = Entry{av_frame_alloc(), 0, 0, 0, 0};
+    }
+
+    ~LatestFrameSlot()
+    {
+        for (auto &entry : entries)
+            av_frame_free(&entry.frame);
+    }
+
+    LatestFrameSlot(const LatestFrameSlot &) = delete;
+    LatestFrameSlot &operator=(const LatestFrameSlot &) = delete;
+
+    /**
+     * Moves the references of frame into the slot. Called by the decoder thread only.
+     */
+    void Publish(AVFrame *frame, int32_t frames_lost, uint64_t hash)
+    {
+        Entry &entry = entries[write_index];
+        if (!entry.frame)
+            return;
+        av_frame_unref(entry.frame);
+        av_frame_move_ref(entry.frame, frame);
+        entry.sequence = ++published;
+        entry.decoded_ns = FrameClockNs();
+        entry.hash = hash;
+
+        // Added before the frame becomes visible, so losses are never reported after the frame they precede
+        pending_frames_lost.fetch_add(frames_lost, std::memory_order_relaxed);
+        write_index = shared.exchange(write_index | FRESH) & INDEX_MASK;
+
+        // Waking readers costs a lock, so only pay for it when someone waits
+        if (waiters.load() > 0)
+        {
+            {
+                std::lock_guard<std::mutex> lock(wait_mutex);
+            }
+            wait_cond.notify_all();
+        }
+    }
+
+    std::unique_lock<std::mutex> Lock() { return std::unique_lock<std::mutex>(read_mutex); }
+
+    /**
+     * @return the newest frame that was not acquired before, or nullptr if there is none.
+     * The entry stays valid until the next call to Acquire().
+     */
+    const Entry *Acquire()
+    {
+        if (!(shared.load(std::memory_order_acquire) & FRESH))
+            return nullptr;
+        read_index = shared.exchange(read_index, std::memory_order_acq_rel) & INDEX_MASK;
+        Entry &entry = entries[read_index];
+        entry.frames_lost = pending_frames_lost.exchange(0, std::memory_order_relaxed);
+        return &entry;
+    }
+
+    /**
+     * Blocks until there is a frame that was not acquired yet.
+     * @return false if deadline passed first
+     */
+    bool WaitForFrame(std::chrono::steady_clock::time_point deadline)
+    {
+        waiters++;
+        std::unique_lock<std::mutex> lock(wait_mutex);
+        bool fresh = wait_cond.wait_until(lock, deadline, [this]()
+                                          { return (shared.load() & FRESH) != 0; });
+        waiters--;
+        return fresh;
+    }
+
+    /**
+     * @return the number of frames published so far
+     */
+    uint64_t GetPublishedCount() const { return published.load(); }
+
+private:
+    static constexpr int INDEX_MASK = 0x3;
+    static constexpr int FRESH = 0x4;
+
+    Entry entries[3];
+    int write_index;
+    int read_index;
+    std::atomic<int> shared;
+    std::atomic<uint64_t> published;
+    std::atomic<int32_t> pending_frames_lost;
+    std::mutex read_mutex;
+
+    std::atomic<int> waiters;
+    std::mutex wait_mutex;
+    std::condition_variable wait_cond;
+};
+
+#endif // CHIAKI_PY_LATEST_FRAME_H
@@ -0,0 +1,62 @@
+#ifndef CHIAKI_PY_LUMA_PLANE_H
+#define CHIAKI_PY_LUMA_PLANE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+extern "C"
+{
+#include <libavutil/frame.h>
+#include <libavutil/pixdesc.h>
+}
+
+/**
+ * Read-only view of the luma samples of a system memory frame in any YUV format.
+ */
+struct LumaPlane
+{
+    const uint8_t *data = nullptr;
+    int linesize = 0;
+    int step = 0;
+    int offset = 0;
+    int depth = 0;
+    int shift = 0;
+    int width = 0;
+    int height = 0;
+
+    /**
+     * @return false if frame has no luma plane that can be read directly, e.g. RGB or hardware frames
+     */
+    bool Init(const AVFrame *frame)
+    {
+        const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get(static_cast<AVPixelFormat>(frame->format));
+        if (!desc || desc->nb_components < 1 || desc->comp[0].plane != 0 ||
+            (desc->flags & (AV_PIX_FMT_FLAG_RGB | AV_PIX_FMT_FLAG_PAL | AV_PIX_FMT_FLAG_HWACCEL | AV_PIX_FMT_FLAG_BE | AV_PIX_FMT_FLAG_BITSTREAM)))
+        {
+            return false;
+        }
+        data = frame->data[0];
+        linesize = frame->linesize[0];
+        step = desc->comp[0].step;
+        offset = desc->comp[0].offset;
+        depth = desc->comp[0].depth;
+        shift = desc->comp[0].shift;
+        width = frame->width;
+        height = frame->height;
+        return data != nullptr;
+    }
+
+    // Samples are reduced to 8 bits, so thresholds mean the same for every bit depth
+    uint8_t At(int x, int y) const
+    {
+        const uint8_t *p = data + (ptrdiff_t)y * linesize + x * step + offset;
+        if (depth <= 8)
+            return *p;
+        uint16_t value;
+        memcpy(&value, p, sizeof(value));
+        return static_cast<uint8_t>(value >> (shift + depth - 8));
+    }
+};
+
+#endif // CHIAKI_PY_LUMA_PLANE_H
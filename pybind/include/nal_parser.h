@@ -0,0 +1,79 @@
+#ifndef CHIAKI_PY_NAL_PARSER_H
+#define CHIAKI_PY_NAL_PARSER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/**
+ * Calls fn(nal, size) for every NAL unit of an Annex B byte stream, without its start code.
+ */
+template <typename Fn>
+void ForEachNalUnit(const uint8_t *buf, size_t size, Fn fn)
+{
+    const uint8_t *nal = nullptr;
+    size_t i = 0;
+    while (i + 2 < size)
+    {
+        if (buf[i] != 0 || buf[i + 1] != 0 || buf[i + 2] != 1)
+        {
+            i++;
+            continue;
+        }
+        if (nal)
+        {
+            // The leading zero of a 4 byte start code is not part of the previous unit
+            const uint8_t *end = buf + i;
+            while (end > nal && end[-1] == 0)
+                end--;
+            fn(nal, static_cast<size_t>(end - nal));
+        }
+        i += 3;
+        nal = buf + i;
+    }
+    if (nal && nal < buf + size)
+        fn(nal, static_cast<size_t>(buf + size - nal));
+}
+
+inline int GetNalUnitType(const uint8_t *nal, bool hevc)
+{
+    return hevc ? (nal[0] >> 1) & 0x3f : nal[0] & 0x1f;
+}
+
+inline bool IsKeyframeNalUnit(int type, bool hevc)
+{
+    // H.264 IDR slice, H.265 IRAP pictures (BLA, IDR, CRA)
+    return hevc ? type >= 16 && type <= 21 : type == 5;
+}
+
+inline bool IsParameterSetNalUnit(int type, bool hevc)
+{
+    // H.264 SPS and PPS, H.265 VPS, SPS and PPS
+    return hevc ? type >= 32 && type <= 34 : type == 7 || type == 8;
+}
+
+/**
+ * Inspects a sample of the video stream.
+ * @param parameter_sets if not nullptr, the parameter sets of the sample are appended to it in Annex B format
+ * @return true if the sample starts a new group of pictures
+ */
+inline bool ParseVideoSample(const uint8_t *buf, size_t size, bool hevc, std::vector<uint8_t> *parameter_sets)
+{
+    static const uint8_t start_code[] = {0, 0, 0, 1};
+    bool keyframe = false;
+    ForEachNalUnit(buf, size, [&](const uint8_t *nal, size_t nal_size)
+                   {
+        if (!nal_size)
+            return;
+        int type = GetNalUnitType(nal, hevc);
+        if (IsKeyframeNalUnit(type, hevc))
+            keyframe = true;
+        else if (parameter_sets && IsParameterSetNalUnit(type, hevc))
+        {
+            parameter_sets->insert(parameter_sets->end(), start_code, start_code + sizeof(start_code));
+            parameter_sets->insert(parameter_sets->end(), nal, nal + nal_size);
+        } });
+    return keyframe;
+}
+
+#endif // CHIAKI_PY_NAL_PARSER_H
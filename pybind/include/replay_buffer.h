@@ -0,0 +1,109 @@
+#ifndef CHIAKI_PY_REPLAY_BUFFER_H
+#define CHIAKI_PY_REPLAY_BUFFER_H
+
+#include "video_recorder.h"
+
+#include <chiaki/common.h>
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+ * Keeps the last seconds of the compressed video stream in memory, so they can be written out after the fact.
+ *
+ * The buffer always starts at a keyframe and is trimmed one group of pictures at a time, so it holds at least
+ * max_duration_us of video whenever the stream has keyframes that often. If it exceeds max_bytes without a
+ * newer keyframe to trim to, or the session lost frames, everything is dropped and buffering restarts at the next
+ * keyframe.
+ *
+ * The console only sends keyframes at the start and after a loss, so request_keyframe is called on the receive
+ * thread while the buffer waits for one to start from, and once its oldest group of pictures is longer than
+ * max_duration_us. It is repeated at most every KEYFRAME_REQUEST_INTERVAL_US until a keyframe arrives.
+ */
+class ReplayBuffer : public VideoSampleSink
+{
+public:
+    /**
+     * Called on the dump thread, error is empty on success.
+     */
+    typedef std::function<void(const std::string &path, const std::string &error)> DumpCallback;
+
+    static constexpr int64_t KEYFRAME_REQUEST_INTERVAL_US = 1000000;
+
+    ReplayBuffer(ChiakiCodec codec, int width, int height, int64_t max_duration_us, size_t max_bytes,
+                 std::function<void()> request_keyframe);
+    /**
+     * Finishes pending dumps.
+     */
+    ~ReplayBuffer() override;
+
+    ReplayBuffer(const ReplayBuffer &) = delete;
+    ReplayBuffer &operator=(const ReplayBuffer &) = delete;
+
+    void PushVideoSample(const uint8_t *buf, size_t buf_size, int32_t frames_lost, bool frame_recovered) override;
+
+    /**
+     * Writes a snapshot of the buffer into path on a background thread.
+     * The snapshot shares the sample data with the buffer, taking it costs no copies.
+     */
+    void DumpAsync(const std::string &path, const std::string &format, DumpCallback callback);
+
+    double GetBufferedSeconds();
+    size_t GetBufferedBytes();
+
+private:
+    struct Sample
+    {
+        std::shared_ptr<const std::vector<uint8_t>> data;
+        int64_t time_us;
+        bool keyframe;
+    };
+
+    struct DumpJob
+    {
+        std::string path;
+        std::string format;
+        std::vector<Sample> samples;
+        std::vector<uint8_t> parameter_sets;
+        DumpCallback callback;
+    };
+
+    ChiakiCodec codec;
+    bool hevc;
+    int width;
+    int height;
+    int64_t max_duration_us;
+    size_t max_bytes;
+    std::function<void()> request_keyframe;
+    /** Only used by the receive thread */
+    int64_t last_request_us;
+
+    std::mutex mutex;
+    std::deque<Sample> samples;
+    /** Positions of the keyframes in samples, counted from the start of the stream */
+    std::deque<uint64_t> keyframes;
+    uint64_t front_index;
+    size_t buffered_bytes;
+    std::vector<uint8_t> parameter_sets;
+
+    std::mutex dump_mutex;
+    std::condition_variable dump_cond;
+    std::deque<DumpJob> dump_jobs;
+    bool stopping;
+    std::thread dump_thread;
+
+    void Trim();
+    bool NeedsKeyframe(int64_t now_us) const;
+    void Clear();
+    void RunDumps();
+    void Dump(const DumpJob &job);
+};
+
+#endif // CHIAKI_PY_REPLAY_BUFFER_H
@@ -0,0 +1,80 @@
+#ifndef CHIAKI_PY_ROI_DETECTOR_H
+#define CHIAKI_PY_ROI_DETECTOR_H
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+extern "C"
+{
+#include <libavutil/frame.h>
+}
+
+/**
+ * Payload of the region changed event.
+ */
+struct RegionChange
+{
+    int region_id = 0;
+    /** Mean absolute luma difference to the state of the region when it last changed, 0 - 255 */
+    double difference = 0.0;
+    int64_t pts = 0;
+    /** FrameClockNs() when the change was detected */
+    int64_t detected_ns = 0;
+};
+
+/**
+ * Watches rectangles of the decoded frames for changes.
+ *
+ * Every region keeps a sparse grid of luma samples, at most MAX_SAMPLES_PER_AXIS in each direction, taken
+ * from the Y plane when the region last changed. A new frame changes a region when the mean absolute
+ * difference of its samples exceeds the region's threshold, so slow fades are reported once they add up.
+ * Regions can be added and removed from any thread while Process() is called by the decoder thread.
+ */
+class RoiChangeDetector
+{
+public:
+    static constexpr int MAX_SAMPLES_PER_AXIS = 64;
+
+    RoiChangeDetector();
+
+    RoiChangeDetector(const RoiChangeDetector &) = delete;
+    RoiChangeDetector &operator=(const RoiChangeDetector &) = delete;
+
+    /**
+     * @return the id of the new region
+     */
+    int AddRegion(int x, int y, int width, int height, double threshold);
+    bool RemoveRegion(int id);
+    void ClearRegions();
+
+    /**
+     * Lock-free check so the decoder thread can skip Process() while nothing is watched.
+     */
+    bool HasRegions() const { return region_count.load(std::memory_order_relaxed) > 0; }
+
+    /**
+     * Compares frame against all regions and appends the ones that changed to changes.
+     * The first frame only records the initial state of each region. Hardware frames are skipped, the caller
+     * downloads them once for every consumer of the frame.
+     */
+    void Process(const AVFrame *frame, std::vector<RegionChange> &changes);
+
+private:
+    struct Region
+    {
+        int id;
+        int x, y, width, height;
+        double threshold;
+        std::vector<uint8_t> reference;
+        std::vector<uint8_t> samples;
+    };
+
+    std::mutex mutex;
+    std::vector<Region> regions;
+    int next_id;
+    std::atomic<int> region_count;
+};
+
+#endif // CHIAKI_PY_ROI_DETECTOR_H
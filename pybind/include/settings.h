@@ -4,6 +4,7 @@
 #define CHIAKI_PY_SETTINGS_H
 
 #include "host.h"
+#include "conversion_backend.h"
 
 #include <unordered_map>
 #include <string>
@@ -119,6 +120,8 @@ class Settings
         unsigned int dpadTouchShortcut3;
         unsigned int dpadTouchShortcut4;
         std::string psnAccountId;
+        unsigned int conversionThreads;
+        ConversionBackend conversionBackend;
         // ChiakiConnectVideoProfile videoProfileLocalPS4;
         // ChiakiConnectVideoProfile videoProfileRemotePS4;
         // ChiakiConnectVideoProfile videoProfileLocalPS5;
@@ -255,6 +258,15 @@ class Settings
 		std::string GetPsnAccountId() const { return psnAccountId; }
         void SetPsnAccountId(std::string psnAccountId) { this->psnAccountId = psnAccountId; }
 
+        /**
+         * @return number of threads converting decoded frames, 0 if set to "automatic" (one per CPU core)
+         */
+        unsigned int GetConversionThreads() const { return conversionThreads; }
+        void SetConversionThreads(unsigned int conversionThreads) { this->conversionThreads = conversionThreads; }
+
+        ConversionBackend GetConversionBackend() const { return conversionBackend; }
+        void SetConversionBackend(ConversionBackend conversionBackend) { this->conversionBackend = conversionBackend; }
+
         ChiakiConnectVideoProfile GetVideoProfileLocalPS4();
 		ChiakiConnectVideoProfile GetVideoProfileRemotePS4();
 		ChiakiConnectVideoProfile GetVideoProfileLocalPS5();
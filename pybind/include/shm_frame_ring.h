@@ -0,0 +1,153 @@
+#ifndef CHIAKI_PY_SHM_FRAME_RING_H
+#define CHIAKI_PY_SHM_FRAME_RING_H
+
+#include "frame_converter.h"
+#include "frame_info.h"
+#include "latest_frame.h"
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <thread>
+
+/**
+ * Named shared memory ring of converted frames, written by one session and read by any number of processes.
+ *
+ * All frames in a ring have the same size and format, which are fixed when it is created. Every slot is guarded
+ * by a seqlock: the writer makes its counter odd while it writes, readers copy the frame out and retry if the
+ * counter changed meanwhile. Readers never block the writer, a reader that is too slow simply gets a newer frame.
+ */
+class ShmFrameRing
+{
+public:
+    static constexpr uint32_t MAGIC = 0x43505246; // "CPRF"
+    static constexpr uint32_t VERSION = 2;
+
+    struct Header
+    {
+        uint32_t magic;
+        uint32_t version;
+        uint32_t slot_count;
+        uint32_t width;
+        uint32_t height;
+        int32_t format;
+        uint64_t frame_size;
+        uint64_t slot_stride;
+        /** Number of frames written so far, the latest one is in slot (write_count - 1) % slot_count */
+        std::atomic<uint64_t> write_count;
+    };
+
+    struct SlotHeader
+    {
+        /** Seqlock counter, odd while the slot is written */
+        std::atomic<uint64_t> lock;
+        /** Value of write_count after this frame was written */
+        uint64_t frame_number;
+        FrameInfo info;
+    };
+
+    /**
+     * Creates a new ring, replacing a stale one with the same name.
+     */
+    static ShmFrameRing Create(const std::string &name, uint32_t slot_count, uint32_t width, uint32_t height, FrameFormat format);
+
+    /**
+     * Opens a ring created by another process.
+     */
+    static ShmFrameRing Open(const std::string &name);
+
+    ShmFrameRing(ShmFrameRing &&other) noexcept;
+    ShmFrameRing(const ShmFrameRing &) = delete;
+    ShmFrameRing &operator=(const ShmFrameRing &) = delete;
+    ~ShmFrameRing();
+
+    Header *GetHeader() const { return header; }
+    SlotHeader *GetSlot(uint64_t index) const;
+    uint8_t *GetSlotData(uint64_t index) const { return reinterpret_cast<uint8_t *>(GetSlot(index)) + SlotDataOffset(); }
+
+    static size_t SlotDataOffset();
+
+private:
+    ShmFrameRing() = default;
+
+    std::string name;
+    bool owner = false;
+    Header *header = nullptr;
+    size_t mapping_size = 0;
+#ifdef _WIN32
+    void *mapping = nullptr;
+#endif
+
+    void Map(size_t size, bool create);
+};
+
+/**
+ * Publishes the frames of a session into a ShmFrameRing.
+ *
+ * The decoder thread only hands over a reference to each frame, conversion happens on the sink's own thread
+ * straight into the shared memory. Frames arriving while the sink is busy are skipped. Slicing uses the worker
+ * pool of the session's converter, so the sink does not add conversion threads of its own.
+ */
+class ShmFrameSink
+{
+public:
+    /**
+     * Converts with the backend and on the worker threads of session_converter, which must outlive the sink.
+     */
+    ShmFrameSink(const std::string &name, uint32_t slot_count, uint32_t width, uint32_t height, FrameFormat format,
+                 FrameConverter &session_converter);
+    ~ShmFrameSink();
+
+    ShmFrameSink(const ShmFrameSink &) = delete;
+    ShmFrameSink &operator=(const ShmFrameSink &) = delete;
+
+    /**
+     * Queues a new reference to frame for writing. Called by the decoder thread.
+     */
+    void Push(const AVFrame *frame, int32_t frames_lost, uint64_t hash);
+
+private:
+    ShmFrameRing ring;
+    FrameConverter converter;
+    LatestFrameSlot pending;
+    AVFrame *push_frame;
+    std::atomic<bool> running;
+    std::thread thread;
+
+    void Run();
+    void Write(const LatestFrameSlot::Entry *entry);
+};
+
+/**
+ * Reads frames from a ShmFrameRing created by another process.
+ */
+class ShmFrameReader
+{
+public:
+    explicit ShmFrameReader(const std::string &name);
+
+    uint32_t GetWidth() const { return ring.GetHeader()->width; }
+    uint32_t GetHeight() const { return ring.GetHeader()->height; }
+    FrameFormat GetFormat() const { return (FrameFormat)ring.GetHeader()->format; }
+    uint32_t GetSlotCount() const { return ring.GetHeader()->slot_count; }
+    uint64_t GetFrameSize() const { return ring.GetHeader()->frame_size; }
+    uint64_t GetWriteCount() const { return ring.GetHeader()->write_count.load(std::memory_order_acquire); }
+
+    /**
+     * Copies the latest frame into target if it is newer than the previously read one.
+     * Gives up with NoFrame if the writer keeps the slot busy or failed to fill it.
+     */
+    FrameResult ReadLatest(uint8_t *target, size_t target_size, FrameInfo *info);
+
+    /**
+     * Polls until a frame newer than the previously read one was written.
+     * @return false if timeout_ms passed first
+     */
+    bool WaitForFrame(int timeout_ms) const;
+
+private:
+    ShmFrameRing ring;
+    uint64_t last_read;
+};
+
+#endif // CHIAKI_PY_SHM_FRAME_RING_H
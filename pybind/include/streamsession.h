@@ -12,6 +12,7 @@
 #include <thread>
 #include <chrono>
 #include <atomic>
+#include <algorithm>
 
 #include "timer.h"
 #include "exception.h"
@@ -20,6 +21,17 @@
 #include "settings.h"
 #include "elapsed_timer.h"
 #include "event_source.h"
+#include "event_dispatcher.h"
+#include "frame_converter.h"
+#include "latest_frame.h"
+#include "frame_decimator.h"
+#include "roi_detector.h"
+#include "frame_hash.h"
+#include "video_recorder.h"
+#include "replay_buffer.h"
+#include "video_sample.h"
+#include "keyframe_filter.h"
+#include "shm_frame_ring.h"
 
 #include <chiaki/session.h>
 #include <chiaki/opusdecoder.h>
@@ -84,6 +96,8 @@ struct StreamSessionConnectInfo
 	unsigned int dpad_touch_shortcut2;
 	unsigned int dpad_touch_shortcut3;
 	unsigned int dpad_touch_shortcut4;
+	unsigned int conversion_threads = 1;
+	ConversionBackend conversion_backend = ConversionBackend::Swscale;
 
 	StreamSessionConnectInfo() {}
     StreamSessionConnectInfo(
@@ -154,12 +168,44 @@ class StreamSession
         std::atomic<bool> dpad_touch_running{true};
         std::atomic<bool> dpad_touch_stop_running{true};
         Timer double_tap_timer;
+        Timer packet_loss_timer;
         RumbleHapticsIntensity rumble_haptics_intensity;
 		bool start_mic_unmuted;
 		bool session_started;
 
 		ChiakiFfmpegDecoder *ffmpeg_decoder;
+		FrameConverter frame_converter;
+		LatestFrameSlot latest_frame;
+		FrameDecimator frame_decimator;
+		FrameHasher frame_hasher;
+		// Download of the current hardware frame, shared by everything on the decoder thread that reads pixels
+		AVFrame *sw_frame;
+		AVFrame *SoftwareFrame(AVFrame *frame);
+		int32_t decimated_frames_lost = 0;
+		RoiChangeDetector roi_detector;
+		std::vector<RegionChange> region_changes;
+		std::unique_ptr<ShmFrameSink> shm_sink;
+		std::mutex shm_sink_mutex;
 		void TriggerFfmpegFrameAvailable();
+		ChiakiCodec video_codec;
+		// Native only, every sink is a subscription, so removing one waits for a push in flight
+		EventSource<VideoSampleData> RawVideoSampleReceived;
+		std::vector<std::pair<std::shared_ptr<VideoSampleSink>, std::shared_ptr<EventSource<VideoSampleData>::Subscription>>> video_sample_sinks;
+		std::mutex video_sample_sinks_mutex;
+		uint64_t video_sample_index = 0;
+		std::shared_ptr<VideoSamplePool> video_sample_pool = std::make_shared<VideoSamplePool>();
+		std::unique_ptr<KeyframeFilter> keyframe_filter;
+		int32_t filtered_frames_lost = 0;
+		std::shared_ptr<VideoRecorder> recorder;
+		std::mutex recorder_mutex;
+		std::shared_ptr<ReplayBuffer> replay_buffer;
+		std::mutex replay_buffer_mutex;
+		void ResetReplayBuffer();
+		bool PushVideoSample(uint8_t *buf, size_t buf_size, int32_t frames_lost, bool frame_recovered);
+		// Set from any thread, the receive thread sends the request with the next sample
+		std::atomic<bool> keyframe_requested{false};
+		void RequestKeyframe() { keyframe_requested.store(true, std::memory_order_relaxed); }
+		void SendKeyframeRequest();
 		std::string audio_out_device_name;
 		std::string audio_in_device_name;
 		// size_t audio_out_sample_size;
@@ -183,6 +229,8 @@ class StreamSession
             if (OnUpdateGamepads) OnUpdateGamepads();
         }
 
+        // Delivers all events but VideoSampleReceived, whose samples are only valid while the receive thread waits
+        EventDispatcher event_dispatcher;
         EventSource<bool> FfmpegFrameAvailable;
         EventSource<ChiakiQuitReason> SessionQuit;
         EventSource<bool> LoginPINRequested;
@@ -193,6 +241,9 @@ class StreamSession
         EventSource<double> MeasuredBitrateChanged;
         EventSource<double> AveragePacketLossChanged;
         EventSource<bool> CantDisplayChanged;
+        EventSource<RegionChange> RegionChanged;
+        EventSource<std::string> ReplayDumped;
+        EventSource<std::shared_ptr<PyVideoSample>> VideoSampleReceived;
 
     public:
 		explicit StreamSession(const StreamSessionConnectInfo &connect_info);
@@ -227,6 +278,86 @@ class StreamSession
             return controller_list;
         }
         ChiakiFfmpegDecoder *GetFfmpegDecoder()	{ return ffmpeg_decoder; }
+        FrameConverter *GetFrameConverter()	{ return &frame_converter; }
+        LatestFrameSlot *GetLatestFrameSlot()	{ return &latest_frame; }
+
+        void SetEveryNthFrame(uint32_t n) { frame_decimator.SetEveryNthFrame(n); }
+        uint32_t GetEveryNthFrame() const { return frame_decimator.GetEveryNthFrame(); }
+        void SetMaxDeliveryFps(double fps) { frame_decimator.SetMaxFps(fps); }
+        double GetMaxDeliveryFps() const { return frame_decimator.GetMaxFps(); }
+        uint64_t GetSkippedFrameCount() const { return frame_decimator.GetSkippedCount(); }
+        void SetSuppressDuplicates(bool enabled, int max_distance) { frame_decimator.SetDuplicateDistance(enabled ? std::max(0, max_distance) : -1); }
+        bool GetSuppressDuplicates() const { return frame_decimator.GetSuppressDuplicates(); }
+        uint64_t GetDuplicateFrameCount() const { return frame_decimator.GetDuplicateCount(); }
+
+        /**
+         * Watches a rectangle of the delivered frames, RegionChanged fires when its mean luma difference exceeds threshold.
+         */
+        int AddChangeRegion(int x, int y, int width, int height, double threshold) { return roi_detector.AddRegion(x, y, width, height, threshold); }
+        bool RemoveChangeRegion(int id) { return roi_detector.RemoveRegion(id); }
+        void ClearChangeRegions() { roi_detector.ClearRegions(); }
+
+        /**
+         * Starts publishing every frame, converted to format and width x height, into the shared memory ring name.
+         * A width or height of 0 uses the resolution of the video profile. Replaces a running sink.
+         */
+        void StartShmSink(const std::string &name, FrameFormat format, uint32_t width, uint32_t height, uint32_t slot_count);
+        void StopShmSink();
+
+        /**
+         * Sinks receive every compressed video sample before it is decoded.
+         */
+        void AddVideoSampleSink(const std::shared_ptr<VideoSampleSink> &sink);
+        void RemoveVideoSampleSink(const std::shared_ptr<VideoSampleSink> &sink);
+
+        /**
+         * Starts remuxing the video stream into path without decoding it. Replaces a running recording.
+         * @param format container format name, empty to pick it from the extension of path
+         */
+        void StartRecording(const std::string &path, const std::string &format);
+        /**
+         * Finishes the file, throws if the recording failed on the way.
+         */
+        void StopRecording();
+        bool IsRecording();
+
+        /**
+         * Low power mode that only decodes intra coded samples, at most one every min_interval seconds if it is positive.
+         * With an interval, a keyframe is requested from the console whenever it passed without one.
+         */
+        void SetKeyframeOnly(bool enabled, double min_interval)
+        {
+            keyframe_filter->SetMinInterval(static_cast<int64_t>(std::max(0.0, min_interval) * 1e6));
+            keyframe_filter->SetEnabled(enabled);
+        }
+        bool GetKeyframeOnly() const { return keyframe_filter->GetEnabled(); }
+        uint64_t GetUndecodedSampleCount() const { return keyframe_filter->GetDroppedCount(); }
+        uint64_t GetKeyframeRequestCount() const { return keyframe_filter->GetKeyframeRequestCount(); }
+
+        /**
+         * Starts keeping the last seconds of the video stream in memory, at most max_bytes of it.
+         * Replaces the buffered video if replay was already enabled.
+         */
+        void EnableReplay(double seconds, size_t max_bytes);
+        void DisableReplay();
+        /**
+         * Writes the buffered video into path in the background, ReplayDumped reports the outcome.
+         */
+        void DumpReplay(const std::string &path, const std::string &format);
+        double GetReplaySeconds();
+
+        /**
+         * Events Python never received, dropped by the backpressure policies or replaced by a newer value.
+         */
+        uint64_t GetDroppedEventCount() const;
+
+#ifdef CHIAKI_PY_TEST_HOOKS
+        /**
+         * For tests without a console: emits frame_count frame available events from each of thread_count native
+         * threads, joins them and then emits a session quit from the calling thread if quit is set.
+         */
+        void EmitTestEvents(uint32_t frame_count, uint32_t thread_count, bool quit);
+#endif
 
         const EventSource<bool> &OnFfmpegFrameAvailable() { return FfmpegFrameAvailable; }
         const EventSource<ChiakiQuitReason> &OnSessionQuit() { return SessionQuit; }
@@ -238,6 +369,9 @@ class StreamSession
         const EventSource<double> &OnMeasuredBitrateChanged() { return MeasuredBitrateChanged; }
         const EventSource<double> &OnAveragePacketLossChanged() { return AveragePacketLossChanged; }
         const EventSource<bool> &OnCantDisplayChanged() { return CantDisplayChanged; }
+        const EventSource<RegionChange> &OnRegionChanged() { return RegionChanged; }
+        const EventSource<std::string> &OnReplayDumped() { return ReplayDumped; }
+        const EventSource<std::shared_ptr<PyVideoSample>> &OnVideoSample() { return VideoSampleReceived; }
 
         void pressCross() { controller_state.buttons |= CHIAKI_CONTROLLER_BUTTON_CROSS; SendFeedbackState(); }
         void releaseCross() { controller_state.buttons &= ~CHIAKI_CONTROLLER_BUTTON_CROSS; SendFeedbackState(); }
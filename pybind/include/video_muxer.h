@@ -0,0 +1,57 @@
+#ifndef CHIAKI_PY_VIDEO_MUXER_H
+#define CHIAKI_PY_VIDEO_MUXER_H
+
+#include <chiaki/common.h>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+extern "C"
+{
+#include <libavformat/avformat.h>
+}
+
+/**
+ * Writes compressed H.264/H.265 samples into a container file through libavformat, without decoding them.
+ *
+ * The container is picked from format, or from the extension of path if format is empty. Its header can
+ * only be written once the parameter sets are known, so Start() is called with those of the first keyframe.
+ */
+class VideoMuxer
+{
+public:
+    VideoMuxer(const std::string &path, const std::string &format, ChiakiCodec codec, int width, int height);
+    ~VideoMuxer();
+
+    VideoMuxer(const VideoMuxer &) = delete;
+    VideoMuxer &operator=(const VideoMuxer &) = delete;
+
+    bool IsStarted() const { return started; }
+
+    /**
+     * Writes the container header.
+     * @param parameter_sets VPS/SPS/PPS in Annex B format
+     */
+    void Start(const std::vector<uint8_t> &parameter_sets);
+
+    /**
+     * Writes one sample, timestamps are in microseconds and must increase.
+     */
+    void Write(const uint8_t *buf, size_t size, int64_t time_us, bool keyframe);
+
+    /**
+     * Writes the trailer and closes the file, called by the destructor if needed.
+     */
+    void Finish();
+
+private:
+    std::string path;
+    AVFormatContext *context;
+    AVStream *stream;
+    AVPacket *packet;
+    bool started;
+    int64_t last_dts;
+};
+
+#endif // CHIAKI_PY_VIDEO_MUXER_H
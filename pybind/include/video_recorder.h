@@ -0,0 +1,107 @@
+#ifndef CHIAKI_PY_VIDEO_RECORDER_H
+#define CHIAKI_PY_VIDEO_RECORDER_H
+
+#include "video_muxer.h"
+
+#include <chiaki/common.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+ * Compressed video sample as emitted to native subscribers, buf is only valid during the call.
+ */
+struct VideoSampleData
+{
+    const uint8_t *buf;
+    size_t buf_size;
+    int32_t frames_lost;
+    bool frame_recovered;
+};
+
+/**
+ * Receives the compressed video samples of a session, next to the decoder.
+ * PushVideoSample() is called on the session's receive thread and must not block.
+ */
+class VideoSampleSink
+{
+public:
+    virtual ~VideoSampleSink() = default;
+    virtual void PushVideoSample(const uint8_t *buf, size_t buf_size, int32_t frames_lost, bool frame_recovered) = 0;
+};
+
+/**
+ * Records the video stream of a session into a file by remuxing its samples on a background thread.
+ *
+ * Samples are copied into a bounded queue. If the writer falls so far behind that the queue is full, or the
+ * session lost frames on the network, samples are dropped and recording resumes at the next keyframe, so the
+ * file never contains frames referencing pictures it does not have. request_keyframe is called on the writer
+ * thread whenever it starts waiting for one, timestamps in the file start at the first keyframe written.
+ */
+class VideoRecorder : public VideoSampleSink
+{
+public:
+    static constexpr size_t MAX_QUEUED_SAMPLES = 512;
+
+    VideoRecorder(const std::string &path, const std::string &format, ChiakiCodec codec, int width, int height,
+                  std::function<void()> request_keyframe);
+    /**
+     * Stops the recording if Stop() was not called.
+     */
+    ~VideoRecorder() override;
+
+    /**
+     * Writes the queued samples, finishes the file and waits for the writer thread.
+     * @return the error that stopped the recording or came up while finishing it, empty on success
+     */
+    std::string Stop();
+
+    void PushVideoSample(const uint8_t *buf, size_t buf_size, int32_t frames_lost, bool frame_recovered) override;
+
+    uint64_t GetWrittenCount() const { return written.load(); }
+    uint64_t GetDroppedCount() const { return dropped.load(); }
+
+    /**
+     * @return the error that stopped the recording, empty while it is fine
+     */
+    std::string GetError() const;
+
+private:
+    struct Sample
+    {
+        std::vector<uint8_t> data;
+        int64_t time_us;
+        /** Samples before this one were dropped */
+        bool after_gap;
+    };
+
+    VideoMuxer muxer;
+    bool hevc;
+    std::function<void()> request_keyframe;
+    /** Time of the first sample written, only used by the writer thread */
+    int64_t start_us;
+
+    mutable std::mutex mutex;
+    std::condition_variable cond;
+    std::deque<Sample> queue;
+    bool stopping;
+    bool gap;
+    std::string error;
+
+    std::atomic<uint64_t> written;
+    std::atomic<uint64_t> dropped;
+    std::thread thread;
+
+    void Run();
+    void Write(const Sample &sample, bool &waiting_for_keyframe);
+};
+
+#endif // CHIAKI_PY_VIDEO_RECORDER_H
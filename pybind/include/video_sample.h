@@ -0,0 +1,89 @@
+#ifndef CHIAKI_PY_VIDEO_SAMPLE_H
+#define CHIAKI_PY_VIDEO_SAMPLE_H
+
+#include <pybind11/pybind11.h>
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace py = pybind11;
+
+/**
+ * Recycles the blocks compressed video samples are copied into for Python.
+ *
+ * A block goes back to the pool once the last reference to it is gone, which may be a view Python kept after
+ * the callback returned. The pool may be destroyed before its blocks, they are freed then.
+ */
+class VideoSamplePool : public std::enable_shared_from_this<VideoSamplePool>
+{
+public:
+    static constexpr size_t MAX_FREE_BLOCKS = 8;
+
+    typedef std::shared_ptr<const std::vector<uint8_t>> Block;
+
+    /**
+     * Copies data into a pooled block. Does not need the GIL.
+     */
+    Block Copy(const uint8_t *data, size_t size);
+
+private:
+    std::mutex mutex;
+    std::vector<std::unique_ptr<std::vector<uint8_t>>> free_blocks;
+
+    void Recycle(std::unique_ptr<std::vector<uint8_t>> block);
+};
+
+/**
+ * Compressed video sample handed to Python subscribers.
+ *
+ * The sample is copied once into a pooled block, the views returned by data() and nal_units() point into it.
+ * They are exported through a buffer object that refuses new exports once the callback returned, views taken
+ * before, including slices and arrays made from them, keep the block alive. copy() keeps the data as bytes.
+ */
+class PyVideoSample
+{
+public:
+    PyVideoSample(VideoSamplePool::Block block, uint64_t index, bool keyframe, bool hevc, int32_t frames_lost, bool frame_recovered);
+
+    PyVideoSample(const PyVideoSample &) = delete;
+    PyVideoSample &operator=(const PyVideoSample &) = delete;
+
+    uint64_t index() const { return sample_index; }
+    bool keyframe() const { return is_keyframe; }
+    int32_t frames_lost() const { return lost; }
+    bool frame_recovered() const { return recovered; }
+    size_t size() const { return sample_size; }
+    bool valid() const { return block != nullptr; }
+
+    /**
+     * @return a read-only memoryview of the whole Annex B sample
+     */
+    py::memoryview data();
+
+    /**
+     * @return (nal_unit_type, memoryview) for every NAL unit, without start codes
+     */
+    py::list nal_units();
+
+    py::bytes copy() const;
+
+    /**
+     * Refuses new views from now on, the block is released with the last view. Must be called with the GIL held.
+     */
+    void invalidate();
+
+private:
+    VideoSamplePool::Block block;
+    size_t sample_size;
+    uint64_t sample_index;
+    bool is_keyframe;
+    bool hevc;
+    int32_t lost;
+    bool recovered;
+    /** Buffer protocol exporter of block, created with the first view */
+    py::object buffer;
+};
+
+#endif // CHIAKI_PY_VIDEO_SAMPLE_H
@@ -0,0 +1,131 @@
+#ifndef CHIAKI_PY_WORKER_POOL_H
+#define CHIAKI_PY_WORKER_POOL_H
+
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <vector>
+#include <cstdint>
+
+/**
+ * Small fixed-size pool that runs a batch of indexed tasks in parallel.
+ * The thread calling Run() works on the batch as well, so a pool of n threads spawns n - 1 workers.
+ */
+class WorkerPool
+{
+public:
+    explicit WorkerPool(unsigned int thread_count) : stopping(false), generation(0), busy(0), task_count(0), next_task(0), completed(0)
+    {
+        for (unsigned int i = 1; i < thread_count; i++)
+            workers.emplace_back([this]() { WorkerLoop(); });
+    }
+
+    ~WorkerPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        cond.notify_all();
+        for (auto &worker : workers)
+        {
+            if (worker.joinable())
+                worker.join();
+        }
+    }
+
+    WorkerPool(const WorkerPool &) = delete;
+    WorkerPool &operator=(const WorkerPool &) = delete;
+
+    unsigned int GetThreadCount() const { return static_cast<unsigned int>(workers.size()) + 1; }
+
+    /**
+     * Calls task(i) for every i in [0, count) and blocks until all of them returned.
+     */
+    void Run(int count, std::function<void(int)> task)
+    {
+        if (count <= 0)
+            return;
+
+        if (workers.empty() || count == 1)
+        {
+            for (int i = 0; i < count; i++)
+                task(i);
+            return;
+        }
+
+        std::lock_guard<std::mutex> run_lock(run_mutex);
+        {
+            // Workers still leaving the previous batch must not see this one half set up
+            std::unique_lock<std::mutex> lock(mutex);
+            done_cond.wait(lock, [this]() { return busy == 0; });
+            current_task = std::move(task);
+            task_count = count;
+            next_task = 0;
+            completed = 0;
+            generation++;
+        }
+        cond.notify_all();
+
+        RunTasks();
+
+        std::unique_lock<std::mutex> lock(mutex);
+        done_cond.wait(lock, [this]() { return completed.load() == task_count.load(); });
+        current_task = nullptr;
+    }
+
+private:
+    std::vector<std::thread> workers;
+    std::mutex run_mutex;
+    std::mutex mutex;
+    std::condition_variable cond;
+    std::condition_variable done_cond;
+    bool stopping;
+    uint64_t generation;
+    int busy;
+
+    std::function<void(int)> current_task;
+    std::atomic<int> task_count;
+    std::atomic<int> next_task;
+    std::atomic<int> completed;
+
+    void RunTasks()
+    {
+        while (true)
+        {
+            int i = next_task.fetch_add(1);
+            if (i >= task_count.load())
+                break;
+            current_task(i);
+            if (completed.fetch_add(1) + 1 == task_count.load())
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                done_cond.notify_all();
+            }
+        }
+    }
+
+    void WorkerLoop()
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        uint64_t seen = generation;
+        while (true)
+        {
+            cond.wait(lock, [this, &seen]() { return stopping || generation != seen; });
+            if (stopping)
+                return;
+            seen = generation;
+            busy++;
+            lock.unlock();
+            RunTasks();
+            lock.lock();
+            busy--;
+            if (busy == 0)
+                done_cond.notify_all();
+        }
+    }
+};
+
+#endif // CHIAKI_PY_WORKER_POOL_H
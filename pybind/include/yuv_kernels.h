@@ -0,0 +1,65 @@
+#ifndef CHIAKI_PY_YUV_KERNELS_H
+#define CHIAKI_PY_YUV_KERNELS_H
+
+#include <cstdint>
+
+/**
+ * Hand-vectorized 4:2:0 YUV to packed RGB conversion.
+ *
+ * The fastest kernel supported by the CPU (AVX2, NEON or portable C++) is picked once at runtime.
+ * All kernels produce bit-identical output, chroma is upsampled by sample duplication.
+ */
+
+enum class YuvChromaLayout
+{
+    NV12,
+    YUV420P
+};
+
+enum class YuvColorMatrix
+{
+    BT601,
+    BT709
+};
+
+enum class RgbPixelLayout
+{
+    RGB24,
+    BGR24,
+    RGBA,
+    BGRA
+};
+
+struct YuvImage
+{
+    /**
+     * Y, U and V planes. For NV12 planes[1] is the interleaved UV plane and planes[2] is unused.
+     */
+    const uint8_t *planes[3];
+    int strides[3];
+    int width;
+    int height;
+    YuvChromaLayout chroma;
+    YuvColorMatrix matrix;
+    bool full_range;
+};
+
+struct RgbImage
+{
+    uint8_t *data;
+    int stride;
+    RgbPixelLayout layout;
+};
+
+/**
+ * Converts the rows [y_begin, y_end) of src into the same rows of dst.
+ * y_begin must be even, so that slices never share a chroma row.
+ */
+void ConvertYuvToRgb(const YuvImage &src, const RgbImage &dst, int y_begin, int y_end);
+
+/**
+ * @return the name of the kernel selected for this CPU ("avx2", "neon" or "scalar")
+ */
+const char *GetYuvKernelName();
+
+#endif // CHIAKI_PY_YUV_KERNELS_H
@@ -1,4 +1,10 @@
 #include "av_frame.h"
+#include "dlpack.h"
+
+extern "C"
+{
+#include <libavutil/pixdesc.h>
+}
 
 PyAVFrame::PyAVFrame()
 {
@@ -9,6 +15,20 @@ PyAVFrame::PyAVFrame()
     }
 }
 
+PyAVFrame::PyAVFrame(const AVFrame *src) : PyAVFrame()
+{
+    if (av_frame_ref(frame, src) < 0)
+    {
+        av_frame_free(&frame);
+        throw std::runtime_error("Failed to reference AVFrame");
+    }
+}
+
+PyAVFrame::PyAVFrame(PyAVFrame &&other) noexcept : frame(other.frame)
+{
+    other.frame = nullptr;
+}
+
 PyAVFrame::~PyAVFrame()
 {
     if (frame)
@@ -17,6 +37,12 @@ PyAVFrame::~PyAVFrame()
     }
 }
 
+int PyAVFrame::plane_count() const
+{
+    int count = av_pix_fmt_count_planes((AVPixelFormat)frame->format);
+    return count < 0 ? 0 : count;
+}
+
 py::bytes PyAVFrame::data(int index)
 {
     if (index < 0 || index >= AV_NUM_DATA_POINTERS)
@@ -24,20 +50,193 @@ py::bytes PyAVFrame::data(int index)
     return py::bytes(reinterpret_cast<const char *>(frame->data[index]), frame->linesize[index]);
 }
 
+// Shape of a plane as numpy and DLPack see it: (height, width, channels) or (height, row_bytes) with channels == 1
+struct PlaneLayout
+{
+    int height;
+    int width;
+    int channels;
+};
+
+static PlaneLayout GetPlaneLayout(const AVFrame *frame, int index)
+{
+    const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get((AVPixelFormat)frame->format);
+    int row_bytes = av_image_get_linesize((AVPixelFormat)frame->format, frame->width, index);
+    int height = (index == 1 || index == 2) ? AV_CEIL_RSHIFT(frame->height, desc->log2_chroma_h) : frame->height;
+    if (height <= 0 || row_bytes <= 0 || !frame->data[index])
+    {
+        throw std::runtime_error("Frame not properly initialized");
+    }
+
+    int channels = 0;
+    int depth = 0;
+    for (int c = 0; c < desc->nb_components; c++)
+    {
+        if (desc->comp[c].plane == index)
+        {
+            channels++;
+            depth = desc->comp[c].depth;
+        }
+    }
+
+    if (channels > 1 && depth <= 8 && row_bytes % channels == 0)
+        return PlaneLayout{height, row_bytes / channels, channels};
+    return PlaneLayout{height, row_bytes, 1};
+}
+
+static const AVPixFmtDescriptor *GetSystemMemoryDescriptor(const AVFrame *frame)
+{
+    const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get((AVPixelFormat)frame->format);
+    if (!desc || (desc->flags & AV_PIX_FMT_FLAG_HWACCEL))
+        return nullptr;
+    return desc;
+}
+
+// The consumer owns a reference of its own, so it stays valid after this frame is released or reused.
+// Frames without refcounted buffers are copied once here by av_frame_clone().
+static AVFrame *CloneFrame(const AVFrame *frame)
+{
+    AVFrame *ref = av_frame_clone(frame);
+    if (!ref)
+        throw std::runtime_error("Failed to reference AVFrame");
+    return ref;
+}
+
 py::array_t<uint8_t> PyAVFrame::to_numpy(int index)
 {
-    if (index < 0 || index >= AV_NUM_DATA_POINTERS)
+    if (!GetSystemMemoryDescriptor(frame))
+        throw std::runtime_error("Frame is not in system memory");
+
+    if (index < 0 || index >= plane_count())
         throw std::out_of_range("Invalid data index");
 
-    int height = frame->height;
-    int width = frame->linesize[index]; // Usually bytes per line, but depends on format
-    if (height == 0 || width == 0)
+    PlaneLayout layout = GetPlaneLayout(frame, index);
+    AVFrame *ref = CloneFrame(frame);
+    py::capsule owner(ref, [](void *ptr)
+                      {
+        AVFrame *owned = static_cast<AVFrame *>(ptr);
+        av_frame_free(&owned); });
+
+    py::ssize_t stride = ref->linesize[index];
+    if (layout.channels > 1)
     {
-        throw std::runtime_error("Frame not properly initialized");
+        return py::array_t<uint8_t>(
+            {(py::ssize_t)layout.height, (py::ssize_t)layout.width, (py::ssize_t)layout.channels},
+            {stride, (py::ssize_t)layout.channels, (py::ssize_t)1},
+            ref->data[index],
+            owner);
     }
 
     return py::array_t<uint8_t>(
-        {height, width},
-        {static_cast<size_t>(frame->linesize[index]), sizeof(uint8_t)},
-        frame->data[index]);
-}
\ No newline at end of file
+        {(py::ssize_t)layout.height, (py::ssize_t)layout.width},
+        {stride, (py::ssize_t)1},
+        ref->data[index],
+        owner);
+}
+
+// Everything a DLManagedTensor points to, freed together by its deleter
+struct DLPackContext
+{
+    DLManagedTensor tensor;
+    AVFrame *frame;
+    int64_t shape[3];
+    int64_t strides[3];
+};
+
+static void DLPackDeleter(DLManagedTensor *tensor)
+{
+    DLPackContext *context = static_cast<DLPackContext *>(tensor->manager_ctx);
+    av_frame_free(&context->frame);
+    delete context;
+}
+
+// Capsules that were never consumed still own their tensor, consumers rename them to "used_dltensor"
+static void DLPackCapsuleDestructor(PyObject *capsule)
+{
+    if (PyCapsule_IsValid(capsule, "used_dltensor"))
+        return;
+
+    PyObject *type, *value, *traceback;
+    PyErr_Fetch(&type, &value, &traceback);
+    DLManagedTensor *tensor = static_cast<DLManagedTensor *>(PyCapsule_GetPointer(capsule, "dltensor"));
+    if (tensor && tensor->deleter)
+        tensor->deleter(tensor);
+    else
+        PyErr_WriteUnraisable(capsule);
+    PyErr_Restore(type, value, traceback);
+}
+
+py::capsule PyAVFrame::dlpack(py::object stream, py::object max_version, py::object dl_device, py::object copy)
+{
+    if (!stream.is_none())
+        throw py::buffer_error("Only CPU frames are exported, stream must be None");
+
+    // Only the unversioned capsule is produced, which every max_version allows
+    if (!max_version.is_none())
+    {
+        if (!py::isinstance<py::tuple>(max_version) || py::len(max_version) != 2)
+            throw py::type_error("max_version must be a (major, minor) tuple or None");
+        max_version.cast<std::pair<int, int>>();
+    }
+
+    if (!dl_device.is_none())
+    {
+        if (!py::isinstance<py::tuple>(dl_device) || py::len(dl_device) != 2)
+            throw py::type_error("dl_device must be a (device_type, device_id) tuple or None");
+        auto device = dl_device.cast<std::pair<int, int>>();
+        if (device.first != kDLCPU || device.second != 0)
+            throw py::buffer_error("Only CPU frames are exported, dl_device must be (kDLCPU, 0)");
+    }
+
+    if (!copy.is_none() && copy.cast<bool>())
+        throw py::buffer_error("Frames are only exported without copying, copy=True is not supported");
+
+    if (!GetSystemMemoryDescriptor(frame))
+        throw py::buffer_error("Frame is not in system memory");
+
+    if (plane_count() != 1)
+        throw py::buffer_error("Only frames with a single plane can be exported, use to_numpy() for planar formats");
+
+    PlaneLayout layout = GetPlaneLayout(frame, 0);
+
+    DLPackContext *context = new DLPackContext();
+    context->frame = av_frame_clone(frame);
+    if (!context->frame)
+    {
+        delete context;
+        throw std::runtime_error("Failed to reference AVFrame");
+    }
+
+    context->shape[0] = layout.height;
+    context->shape[1] = layout.width;
+    context->shape[2] = layout.channels;
+    context->strides[0] = context->frame->linesize[0];
+    context->strides[1] = layout.channels;
+    context->strides[2] = 1;
+
+    DLTensor &tensor = context->tensor.dl_tensor;
+    tensor.data = context->frame->data[0];
+    tensor.device = DLDevice{kDLCPU, 0};
+    tensor.ndim = layout.channels > 1 ? 3 : 2;
+    tensor.dtype = DLDataType{kDLUInt, 8, 1};
+    tensor.shape = context->shape;
+    tensor.strides = context->strides;
+    tensor.byte_offset = 0;
+    context->tensor.manager_ctx = context;
+    context->tensor.deleter = DLPackDeleter;
+
+    return py::capsule(&context->tensor, "dltensor", DLPackCapsuleDestructor);
+}
+
+py::tuple PyAVFrame::dlpack_device()
+{
+    return py::make_tuple((int)kDLCPU, 0);
+}
+
+py::list PyAVFrame::planes()
+{
+    py::list result;
+    for (int i = 0; i < plane_count(); i++)
+        result.append(to_numpy(i));
+    return result;
+}
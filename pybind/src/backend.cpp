@@ -34,14 +34,14 @@ void init_backend(py::module &m)
         .value("ConnectFailedConsoleUnreachable", PsnConnectState::ConnectFailedConsoleUnreachable)
         .export_values();
 
-    py::class_<EventSource<ChiakiRegistEvent *>::Subscription>(m, "RegistEventSourceSubscription")
+    py::class_<EventSource<ChiakiRegistEvent *>::Subscription, std::shared_ptr<EventSource<ChiakiRegistEvent *>::Subscription>>(m, "RegistEventSourceSubscription")
         .def("unsubscribe", &EventSource<ChiakiRegistEvent *>::Subscription::unsubscribe);
 
     py::class_<EventSource<ChiakiRegistEvent *>>(m, "RegistEventSource")
         .def("subscribe", &EventSource<ChiakiRegistEvent *>::subscribe,
              py::arg("on_next"),
              py::arg("on_error") = py::none(),
-             py::arg("on_completed") = py::none(), py::return_value_policy::reference);
+             py::arg("on_completed") = py::none());
 
     py::class_<ChiakiRegisteredHost>(m, "RegisteredHost")
         .def_readonly("target", &ChiakiRegisteredHost::target)
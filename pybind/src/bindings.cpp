@@ -1,5 +1,11 @@
 #include <time.h>
 #include "av_frame.h"
+#include "frame_converter.h"
+#include "frame_info.h"
+#include "shm_frame_ring.h"
+#include "roi_detector.h"
+#include "frame_hash.h"
+#include "video_sample.h"
 #include "core/common.h"
 #include "core/audio.h"
 #include "core/base64.h"
@@ -23,6 +29,7 @@
 #include <stdio.h>
 #include <string>
 #include <set>
+#include <array>
 #include <optional> // Required for std::optional
 
 #define PYBIND11_DETAILED_ERROR_MESSAGES
@@ -37,136 +44,339 @@ extern "C"
 #include <libavutil/frame.h>
 #include <libavutil/pixfmt.h>
 #include <libavutil/imgutils.h>
+#include <libavutil/pixdesc.h>
 #include <libavutil/hwcontext.h>
 #include <libswscale/swscale.h>
 }
 
 namespace py = pybind11;
 
-// Function to return a NumPy array
-py::object get_frame(StreamSession &session, bool disable_zero_copy, py::array_t<uint8_t> target)
+// Hardware formats that have to be downloaded before they can be read
+static const std::set<int> zero_copy_formats = {AV_PIX_FMT_VULKAN,
+                                                AV_PIX_FMT_D3D11
+#ifdef __linux__
+                                                ,
+                                                AV_PIX_FMT_VAAPI
+#endif
+};
+
+// True for YUV formats whose Y plane can be read as GRAY8 as is
+static bool has_gray8_luma_plane(AVPixelFormat format)
 {
-    // Retrieve the FFmpeg decoder
-    ChiakiFfmpegDecoder *decoder = session.GetFfmpegDecoder();
+    const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get(format);
+    return desc && !(desc->flags & (AV_PIX_FMT_FLAG_RGB | AV_PIX_FMT_FLAG_HWACCEL | AV_PIX_FMT_FLAG_PAL)) &&
+           desc->comp[0].plane == 0 && desc->comp[0].step == 1 && desc->comp[0].depth == 8;
+}
 
-    if (!decoder)
+// What read_frame() should make of the next frame
+struct FrameReadOptions
+{
+    bool disable_zero_copy;
+    FrameFormat output_format;
+    // x, y, width, height
+    std::optional<std::array<int, 4>> roi;
+    // width, height
+    std::optional<std::array<int, 2>> size;
+};
+
+// Downloads, crops, converts and copies an acquired frame into target. Runs without the GIL.
+// With exact_size, target_size must match the output image, so batches keep their layout.
+static FrameResult read_entry(StreamSession &session, const LatestFrameSlot::Entry *entry, const FrameReadOptions &options,
+                              uint8_t *target, size_t target_size, bool exact_size, FrameInfo *info)
+{
+    FrameConverter *converter = session.GetFrameConverter();
+    AVFrame *frame = entry->frame;
+    info->pts = frame->pts;
+    info->sequence = entry->sequence;
+    info->frames_lost = entry->frames_lost;
+    info->hash = entry->hash;
+    info->decoded_ns = entry->decoded_ns;
+    info->convert_start_ns = FrameClockNs();
+
+    // Frames returned by the converter stay valid while we hold its lock
+    auto converter_lock = converter->Lock();
+
+    // Handle hardware decoding cases
+    if ((zero_copy_formats.find(frame->format) != zero_copy_formats.end() || options.disable_zero_copy))
     {
-        return py::str("Session has no FFmpeg decoder");
+        frame = converter->TransferHardwareFrame(frame);
+        if (!frame)
+        {
+            return FrameResult::TransferFailed;
+        }
     }
 
-    int32_t frames_lost;
-    AVFrame *frame = chiaki_ffmpeg_decoder_pull_frame(decoder, &frames_lost);
-    if (!frame)
+    // Cropping only moves the plane pointers, so only the region is ever converted
+    if (options.roi)
     {
-        return py::str("Failed to pull frame from FFmpeg decoder");
+        const std::array<int, 4> &roi = *options.roi;
+        frame = converter->Crop(frame, roi[0], roi[1], roi[2], roi[3]);
+        if (!frame)
+        {
+            return FrameResult::InvalidRegion;
+        }
     }
 
-    // Ensure proper cleanup if an error occurs
-    struct AVFrameGuard
+    AVPixelFormat src_format = (AVPixelFormat)frame->format;
+    AVPixelFormat dst_format = GetFramePixelFormat(options.output_format);
+    int width = options.size ? (*options.size)[0] : frame->width;
+    int height = options.size ? (*options.size)[1] : frame->height;
+    if (width <= 0 || height <= 0)
     {
-        AVFrame *frame;
-        ~AVFrameGuard() { av_frame_unref(frame); }
-    } frame_guard{frame};
+        return FrameResult::InvalidSize;
+    }
 
-    // Handle hardware decoding cases
-    static const std::set<int> zero_copy_formats = {AV_PIX_FMT_VULKAN,
-                                                    AV_PIX_FMT_D3D11
-#ifdef __linux__
-                                                    ,
-                                                    AV_PIX_FMT_VAAPI
-#endif
-    };
+    int data_size = av_image_get_buffer_size(dst_format, width, height, 1);
 
-    if ((zero_copy_formats.find(frame->format) != zero_copy_formats.end() || disable_zero_copy))
+    if (data_size <= 0)
     {
-        AVFrame *sw_frame = av_frame_alloc();
-        if (!sw_frame)
-        {
-            return py::str("Failed to allocate software frame");
-        }
+        return FrameResult::InvalidSize;
+    }
 
-        if (av_hwframe_transfer_data(sw_frame, frame, 0) < 0)
-        {
-            av_frame_free(&sw_frame);
-            return py::str("Failed to transfer frame from hardware (D3D11)");
-        }
+    if ((size_t)data_size > target_size)
+    {
+        return FrameResult::TargetTooSmall;
+    }
 
-        av_frame_copy_props(sw_frame, frame);
-        av_frame_unref(frame);
-        frame = sw_frame;
-        frame_guard.frame = frame; // Ensure cleanup
+    if (exact_size && (size_t)data_size != target_size)
+    {
+        return FrameResult::ShapeMismatch;
     }
 
-    if (frame->format == AV_PIX_FMT_NV12) {
-        // Step 1: Initialize SwsContext
-        struct SwsContext *sws_ctx = sws_getContext(
-            frame->width, frame->height, (AVPixelFormat)frame->format,
-            frame->width, frame->height, AV_PIX_FMT_RGB24,
-            SWS_BILINEAR, nullptr, nullptr, nullptr);
+    bool resize = width != frame->width || height != frame->height;
+    if (!resize && src_format == dst_format)
+    {
+        av_image_copy_to_buffer(target, data_size, frame->data, frame->linesize, dst_format, width, height, 1);
+        info->convert_end_ns = FrameClockNs();
+        return FrameResult::Success;
+    }
 
-        if (!sws_ctx)
-        {
-            av_frame_free(&frame);
-            return py::str("Failed to create SwsContext");
-        }
+    if (!resize && dst_format == AV_PIX_FMT_GRAY8 && has_gray8_luma_plane(src_format))
+    {
+        av_image_copy_plane(target, width, frame->data[0], frame->linesize[0], width, height);
+        info->convert_end_ns = FrameClockNs();
+        return FrameResult::Success;
+    }
 
-        // Step 2: Allocate Target Frame
-        AVFrame *rgb_frame = av_frame_alloc();
-        if (!rgb_frame)
-        {
-            sws_freeContext(sws_ctx);
-            return py::str("Failed to allocate RGB frame");
-        }
+    // Convert (and resize) straight into the target, so the output is written exactly once
+    if (!converter->ConvertToBuffer(frame, dst_format, width, height, target, target_size))
+    {
+        return FrameResult::ConversionFailed;
+    }
+    info->convert_end_ns = FrameClockNs();
+    return FrameResult::Success;
+}
+
+// Takes the latest frame and reads it into target. Runs without the GIL.
+static FrameResult read_frame(StreamSession &session, const FrameReadOptions &options, uint8_t *target, size_t target_size, FrameInfo *info)
+{
+    if (!session.GetFfmpegDecoder())
+    {
+        return FrameResult::NoDecoder;
+    }
+
+    // The decoder thread publishes every frame into the slot, the entry stays ours while we hold its lock
+    LatestFrameSlot *slot = session.GetLatestFrameSlot();
+    auto slot_lock = slot->Lock();
+    const LatestFrameSlot::Entry *entry = slot->Acquire();
+    if (!entry)
+    {
+        return FrameResult::NoFrame;
+    }
+    return read_entry(session, entry, options, target, target_size, false, info);
+}
+
+// Python objects of every FrameResult, created once at import so get_frame() never allocates one
+static py::handle frame_result_objects[(int)FrameResult::Count];
+
+// Reads the latest frame into target and reports how that went
+py::object get_frame(StreamSession &session, bool disable_zero_copy, py::array_t<uint8_t> target, FrameFormat output_format,
+                     std::optional<std::array<int, 4>> roi, std::optional<std::array<int, 2>> size, FrameInfo *info, bool raise_on_error)
+{
+    FrameResult result = FrameResult::InvalidTarget;
+    FrameInfo frame_info;
+
+    // Only the target validation needs the GIL, the native pipeline runs without it
+    if (target.flags() & py::array::c_style)
+    {
+        py::buffer_info array_buf = target.request(true);
+        uint8_t *target_ptr = static_cast<uint8_t *>(array_buf.ptr);
+        size_t target_size = static_cast<size_t>(array_buf.size) * array_buf.itemsize;
+
+        py::gil_scoped_release release;
+        result = read_frame(session, FrameReadOptions{disable_zero_copy, output_format, roi, size}, target_ptr, target_size, &frame_info);
+    }
+
+    if (raise_on_error && result != FrameResult::Success && result != FrameResult::NoFrame)
+    {
+        throw FrameError(result);
+    }
+    if (info && result == FrameResult::Success)
+    {
+        *info = frame_info;
+    }
+    return py::reinterpret_borrow<py::object>(frame_result_objects[(int)result]);
+}
 
-        rgb_frame->format = AV_PIX_FMT_RGB24;
-        rgb_frame->width = frame->width;
-        rgb_frame->height = frame->height;
+// Size of one (H, W, C) item of a C-contiguous (N, H, W, C) batch
+static size_t batch_item_size(const py::array_t<uint8_t> &target)
+{
+    if (!(target.flags() & py::array::c_style) || target.ndim() < 2 || target.shape(0) == 0)
+    {
+        throw FrameError(FrameResult::InvalidTarget);
+    }
+    return static_cast<size_t>(target.size() / target.shape(0));
+}
 
-        if (av_image_alloc(rgb_frame->data, rgb_frame->linesize, rgb_frame->width,
-                        rgb_frame->height, AV_PIX_FMT_RGB24, 1) < 0)
+// Fills target[i] with each of the next N frames of the session, waiting for them until the timeout.
+// Returns how many frames were written.
+py::ssize_t get_frames(StreamSession &session, py::array_t<uint8_t> target, FrameFormat output_format,
+                       std::optional<std::array<int, 4>> roi, std::optional<std::array<int, 2>> size, int timeout_ms, bool disable_zero_copy)
+{
+    size_t item_size = batch_item_size(target);
+    py::ssize_t count = target.shape(0);
+    uint8_t *data = target.mutable_data();
+    FrameReadOptions options{disable_zero_copy, output_format, roi, size};
+
+    if (!session.GetFfmpegDecoder())
+    {
+        throw FrameError(FrameResult::NoDecoder);
+    }
+
+    py::ssize_t filled = 0;
+    FrameResult result = FrameResult::Success;
+    {
+        py::gil_scoped_release release;
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms);
+        LatestFrameSlot *slot = session.GetLatestFrameSlot();
+        // The read lock is only held per frame, so other readers of the session are not stuck behind the wait
+        while (filled < count && slot->WaitForFrame(deadline))
         {
-            av_frame_free(&rgb_frame);
-            sws_freeContext(sws_ctx);
-            return py::str("Failed to allocate RGB image buffer");
+            auto slot_lock = slot->Lock();
+            // Another reader may have taken the frame between the wakeup and the lock
+            const LatestFrameSlot::Entry *entry = slot->Acquire();
+            if (!entry)
+                continue;
+            FrameInfo info;
+            result = read_entry(session, entry, options, data + filled * item_size, item_size, true, &info);
+            if (result != FrameResult::Success)
+                break;
+            filled++;
         }
+    }
 
-        // Step 3: Perform the Conversion
-        sws_scale(
-            sws_ctx,
-            frame->data, frame->linesize, 0, frame->height,
-            rgb_frame->data, rgb_frame->linesize);
+    if (result != FrameResult::Success)
+    {
+        throw FrameError(result);
+    }
+    return filled;
+}
 
-        // Clean up the old frame and replace it with the new one
-        av_frame_free(&frame);
-        sws_freeContext(sws_ctx);
-        frame = rgb_frame;
+// Fills target[i] with the latest frame of sessions[i], returns the FrameResult of every session
+py::list get_latest_frames(const std::vector<StreamSession *> &sessions, py::array_t<uint8_t> target, FrameFormat output_format,
+                           std::optional<std::array<int, 4>> roi, std::optional<std::array<int, 2>> size, bool disable_zero_copy)
+{
+    size_t item_size = batch_item_size(target);
+    if ((size_t)target.shape(0) != sessions.size())
+    {
+        throw FrameError(FrameResult::ShapeMismatch);
     }
+    uint8_t *data = target.mutable_data();
+    FrameReadOptions options{disable_zero_copy, output_format, roi, size};
 
-    // Ensure the frame is in a readable format
-    if (frame->format != AV_PIX_FMT_RGB24 && frame->format != AV_PIX_FMT_GRAY8 && frame->format != AV_PIX_FMT_YUV420P) // AV_PIX_FMT_D3D11
+    std::vector<FrameResult> results(sessions.size(), FrameResult::NoDecoder);
     {
-        return py::str("Unsupported pixel format for NumPy conversion");
+        py::gil_scoped_release release;
+        for (size_t i = 0; i < sessions.size(); i++)
+        {
+            StreamSession *session = sessions[i];
+            if (!session || !session->GetFfmpegDecoder())
+                continue;
+
+            LatestFrameSlot *slot = session->GetLatestFrameSlot();
+            auto slot_lock = slot->Lock();
+            const LatestFrameSlot::Entry *entry = slot->Acquire();
+            FrameInfo info;
+            results[i] = entry ? read_entry(*session, entry, options, data + i * item_size, item_size, true, &info) : FrameResult::NoFrame;
+        }
     }
 
-    int height = frame->height;
-    int width = frame->width;
-    // int channels = (frame->format == AV_PIX_FMT_RGB24 || frame->format == AV_PIX_FMT_YUV420P) ? 3 : 1;
-    int data_size = av_image_get_buffer_size((AVPixelFormat)frame->format, width, height, 1);
+    py::list result_list;
+    for (FrameResult result : results)
+        result_list.append(frame_result_objects[(int)result]);
+    return result_list;
+}
 
-    if (data_size <= 0)
+// Copies the latest frame of a shared memory ring into target
+py::object shm_read_latest(ShmFrameReader &reader, py::array_t<uint8_t> target, FrameInfo *info)
+{
+    FrameResult result = FrameResult::InvalidTarget;
+    if (target.flags() & py::array::c_style)
     {
-        return py::str("Failed to get image buffer size");
+        uint8_t *target_ptr = target.mutable_data();
+        size_t target_size = static_cast<size_t>(target.nbytes());
+        FrameInfo frame_info;
+
+        py::gil_scoped_release release;
+        result = reader.ReadLatest(target_ptr, target_size, &frame_info);
+        if (info && result == FrameResult::Success)
+            *info = frame_info;
     }
+    return py::reinterpret_borrow<py::object>(frame_result_objects[(int)result]);
+}
 
-    // Copy data into a buffer
-    std::vector<uint8_t> buffer(data_size);
-    
-    // Request buffer info from the NumPy array
-    py::buffer_info array_buf = target.request();
+// Returns the latest decoded frame as a reference to the decoder's buffers (or to a converted copy if output_format is given),
+// or None if there is no new frame
+py::object pull_frame(StreamSession &session, bool disable_zero_copy, std::optional<FrameFormat> output_format)
+{
+    ChiakiFfmpegDecoder *decoder = session.GetFfmpegDecoder();
 
-    av_image_copy_to_buffer(static_cast<uint8_t *>(array_buf.ptr), data_size, frame->data, frame->linesize, (AVPixelFormat)frame->format, width, height, 1);
+    if (!decoder)
+    {
+        throw std::runtime_error("Session has no FFmpeg decoder");
+    }
 
-    return py::str("Success");
+    std::optional<PyAVFrame> result;
+    {
+        py::gil_scoped_release release;
+
+        LatestFrameSlot *slot = session.GetLatestFrameSlot();
+        auto slot_lock = slot->Lock();
+        const LatestFrameSlot::Entry *entry = slot->Acquire();
+        if (entry)
+        {
+            AVFrame *frame = entry->frame;
+
+            FrameConverter *converter = session.GetFrameConverter();
+            auto converter_lock = converter->Lock();
+            if (frame->hw_frames_ctx || disable_zero_copy)
+            {
+                frame = converter->TransferHardwareFrame(frame);
+                if (!frame)
+                {
+                    throw FrameError(FrameResult::TransferFailed);
+                }
+            }
+
+            // The pool frame is only reused by the converter once the returned frame dropped its reference
+            if (output_format && frame->format != GetFramePixelFormat(*output_format))
+            {
+                frame = converter->Convert(frame, GetFramePixelFormat(*output_format));
+                if (!frame)
+                {
+                    throw FrameError(FrameResult::ConversionFailed);
+                }
+            }
+
+            result.emplace(frame);
+        }
+    }
+
+    if (!result)
+    {
+        return py::none();
+    }
+    return py::cast(std::move(*result));
 }
 
 PYBIND11_MODULE(chiaki_py, m)
@@ -216,7 +426,14 @@ PYBIND11_MODULE(chiaki_py, m)
         .def("pts", &PyAVFrame::pts)
         .def("set_pts", &PyAVFrame::set_pts)
         .def("data", &PyAVFrame::data)
-        .def("to_numpy", &PyAVFrame::to_numpy, "Convert frame data to numpy array");
+        .def("plane_count", &PyAVFrame::plane_count, "Get the number of planes.")
+        .def("to_numpy", &PyAVFrame::to_numpy, py::arg("index"), "Get a zero-copy numpy view on the given plane.")
+        .def("planes", &PyAVFrame::planes, "Get zero-copy numpy views on all planes.")
+        .def("__dlpack__", &PyAVFrame::dlpack, py::kw_only(), py::arg("stream") = py::none(), py::arg("max_version") = py::none(),
+             py::arg("dl_device") = py::none(), py::arg("copy") = py::none(),
+             "Export the frame as a DLPack capsule without copying (single-plane formats only). "
+             "dl_device must be the CPU and copy must not be True.")
+        .def("__dlpack_device__", &PyAVFrame::dlpack_device, "Get the DLPack device of the frame (always CPU).");
 
     py::enum_<RumbleHapticsIntensity>(m, "RumbleHapticsIntensity")
         .value("Off", RumbleHapticsIntensity::Off)
@@ -232,11 +449,142 @@ PYBIND11_MODULE(chiaki_py, m)
         .value("Pi", Decoder::Pi)
         .export_values();
 
+    py::enum_<ConversionBackend>(m, "ConversionBackend")
+        .value("Swscale", ConversionBackend::Swscale)
+        .value("Native", ConversionBackend::Native)
+        .export_values();
+
+    py::class_<FrameInfo>(m, "FrameInfo")
+        .def(py::init<>())
+        .def_readonly("pts", &FrameInfo::pts, "Presentation timestamp of the frame.")
+        .def_readonly("sequence", &FrameInfo::sequence, "Number of the frame since the session started.")
+        .def_readonly("frames_lost", &FrameInfo::frames_lost, "Frames lost by the decoder since the previously read frame.")
+        .def_readonly("decoded_ns", &FrameInfo::decoded_ns, "Time the frame was decoded, see frame_clock_ns().")
+        .def_readonly("convert_start_ns", &FrameInfo::convert_start_ns, "Time the conversion started, see frame_clock_ns().")
+        .def_readonly("convert_end_ns", &FrameInfo::convert_end_ns, "Time the conversion ended, see frame_clock_ns().")
+        .def_readonly("hash", &FrameInfo::hash, "64 bit perceptual hash (dHash) of the frame, compare with frame_hash_distance().")
+        .def("__repr__", [](const FrameInfo &info)
+             {
+                std::ostringstream repr;
+                repr << "<FrameInfo("
+                    << "pts=" << info.pts << ", "
+                    << "sequence=" << info.sequence << ", "
+                    << "frames_lost=" << info.frames_lost << ", "
+                    << "decoded_ns=" << info.decoded_ns << ", "
+                    << "convert_start_ns=" << info.convert_start_ns << ", "
+                    << "convert_end_ns=" << info.convert_end_ns << ", "
+                    << "hash=0x" << std::hex << info.hash << std::dec
+                    << ")>";
+                return repr.str(); });
+
+    py::class_<PyVideoSample, std::shared_ptr<PyVideoSample>>(m, "VideoSample")
+        .def_property_readonly("index", &PyVideoSample::index, "Number of the sample since the session started.")
+        .def_property_readonly("keyframe", &PyVideoSample::keyframe, "Check if the sample contains an IDR or IRAP picture.")
+        .def_property_readonly("frames_lost", &PyVideoSample::frames_lost, "Frames lost by the receiver before this sample.")
+        .def_property_readonly("frame_recovered", &PyVideoSample::frame_recovered, "Check if the sample was recovered through FEC.")
+        .def_property_readonly("size", &PyVideoSample::size, "Get the size of the sample in bytes.")
+        .def_property_readonly("valid", &PyVideoSample::valid, "Check if new views on the sample can still be taken.")
+        .def_property_readonly("data", &PyVideoSample::data,
+                               "Get a read-only memoryview of the Annex B sample. New views can only be taken during the callback, "
+                               "views taken then stay readable afterwards.")
+        .def("nal_units", &PyVideoSample::nal_units, "Get a (nal_unit_type, memoryview) tuple for every NAL unit, available during the callback.")
+        .def("copy", &PyVideoSample::copy, "Copy the sample into bytes that outlive the callback.")
+        .def("__len__", &PyVideoSample::size);
+
+    py::class_<RegionChange>(m, "RegionChange")
+        .def_readonly("region_id", &RegionChange::region_id, "Id returned by add_change_region().")
+        .def_readonly("difference", &RegionChange::difference, "Mean absolute luma difference to the previous state of the region.")
+        .def_readonly("pts", &RegionChange::pts, "Presentation timestamp of the frame.")
+        .def_readonly("detected_ns", &RegionChange::detected_ns, "Time the change was detected, see frame_clock_ns().")
+        .def("__repr__", [](const RegionChange &change)
+             {
+                std::ostringstream repr;
+                repr << "<RegionChange("
+                    << "region_id=" << change.region_id << ", "
+                    << "difference=" << change.difference << ", "
+                    << "pts=" << change.pts << ", "
+                    << "detected_ns=" << change.detected_ns
+                    << ")>";
+                return repr.str(); });
+
+    py::enum_<FrameResult>(m, "FrameResult")
+        .value("Success", FrameResult::Success)
+        .value("NoFrame", FrameResult::NoFrame)
+        .value("NoDecoder", FrameResult::NoDecoder)
+        .value("InvalidTarget", FrameResult::InvalidTarget)
+        .value("TargetTooSmall", FrameResult::TargetTooSmall)
+        .value("ShapeMismatch", FrameResult::ShapeMismatch)
+        .value("TransferFailed", FrameResult::TransferFailed)
+        .value("InvalidRegion", FrameResult::InvalidRegion)
+        .value("InvalidSize", FrameResult::InvalidSize)
+        .value("ConversionFailed", FrameResult::ConversionFailed)
+        .export_values();
+
+    // Released on purpose, they live as long as the module
+    for (int i = 0; i < (int)FrameResult::Count; i++)
+        frame_result_objects[i] = py::cast((FrameResult)i).release();
+
+    m.def("get_frame_result_message", &GetFrameResultMessage, py::arg("result"), "Get the description of a frame result.");
+
+    py::register_exception<FrameError>(m, "FrameError");
+
+    m.def("frame_clock_ns", &FrameClockNs, "Get the current time in nanoseconds on the monotonic clock used for frame timestamps.");
+
+    py::enum_<FrameFormat>(m, "FrameFormat")
+        .value("RGB24", FrameFormat::RGB24)
+        .value("BGR24", FrameFormat::BGR24)
+        .value("RGBA", FrameFormat::RGBA)
+        .value("BGRA", FrameFormat::BGRA)
+        .value("GRAY8", FrameFormat::GRAY8)
+        .value("NV12", FrameFormat::NV12)
+        .value("YUV420P", FrameFormat::YUV420P)
+        .export_values();
+
+    m.def("frame_hash_distance", &GetFrameHashDistance, py::arg("a"), py::arg("b"), "Get the number of differing bits of two frame hashes.");
+    m.def("get_native_conversion_kernel", &GetYuvKernelName, "Get the name of the SIMD kernel used by the native conversion backend.");
+
     m.def("get_frame", &get_frame,
           py::arg("session"),
           py::arg("disable_zero_copy"),
-          py::arg("target"),
-          "Get the next frame from the session.");
+          py::arg("target").noconvert(),
+          py::arg("output_format") = FrameFormat::RGB24,
+          py::arg("roi") = py::none(),
+          py::arg("size") = py::none(),
+          py::arg("info") = py::none(),
+          py::arg("raise_on_error") = false,
+          "Read the latest frame from the session into target, converted to output_format, and return a FrameResult. "
+          "roi=(x, y, width, height) crops the frame and size=(width, height) resizes it (after cropping) in the same pass. "
+          "A FrameInfo passed as info is filled in on success. With raise_on_error, failures other than NoFrame raise FrameError.");
+
+    m.def("get_latest_frames", &get_latest_frames,
+          py::arg("sessions"),
+          py::arg("target").noconvert(),
+          py::arg("output_format") = FrameFormat::RGB24,
+          py::arg("roi") = py::none(),
+          py::arg("size") = py::none(),
+          py::arg("disable_zero_copy") = false,
+          "Fill target[i] of the (N, H, W, C) target with the latest frame of sessions[i] and return their FrameResults.");
+
+    py::class_<ShmFrameReader>(m, "ShmFrameReader")
+        .def(py::init<const std::string &>(), py::arg("name"), "Open the shared memory frame ring of a session in another process.")
+        .def_property_readonly("width", &ShmFrameReader::GetWidth, "Get the width of the frames.")
+        .def_property_readonly("height", &ShmFrameReader::GetHeight, "Get the height of the frames.")
+        .def_property_readonly("format", &ShmFrameReader::GetFormat, "Get the pixel format of the frames.")
+        .def_property_readonly("slot_count", &ShmFrameReader::GetSlotCount, "Get the number of frames the ring holds.")
+        .def_property_readonly("frame_size", &ShmFrameReader::GetFrameSize, "Get the size of a frame in bytes.")
+        .def_property_readonly("write_count", &ShmFrameReader::GetWriteCount, "Get the number of frames written so far.")
+        .def("read_latest", &shm_read_latest,
+             py::arg("target").noconvert(),
+             py::arg("info") = py::none(),
+             "Copy the latest frame into target if it is newer than the previously read one and return a FrameResult.")
+        .def("wait_for_frame", &ShmFrameReader::WaitForFrame, py::arg("timeout_ms"), py::call_guard<py::gil_scoped_release>(),
+             "Wait until a new frame was written, return False on timeout.");
+
+    m.def("pull_frame", &pull_frame,
+          py::arg("session"),
+          py::arg("disable_zero_copy") = false,
+          py::arg("output_format") = py::none(),
+          "Get the latest decoded frame from the session without copying it (converted to output_format if given), or None if no frame is available.");
 
     py::class_<Settings>(m, "Settings")
         .def(py::init<>())
@@ -322,6 +670,10 @@ PYBIND11_MODULE(chiaki_py, m)
         .def("set_dpad_touch_shortcut4", &Settings::SetDpadTouchShortcut4, py::arg("dpad_touch_shortcut4"), "Set the D-pad touch shortcut 4.")
         .def("get_psn_account_id", &Settings::GetPsnAccountId, "Get the PSN account ID.")
         .def("set_psn_account_id", &Settings::SetPsnAccountId, py::arg("psn_account_id"), "Set the PSN account ID.")
+        .def("get_conversion_threads", &Settings::GetConversionThreads, "Get the number of frame conversion threads (0 = one per CPU core).")
+        .def("set_conversion_threads", &Settings::SetConversionThreads, py::arg("conversion_threads"), "Set the number of frame conversion threads (0 = one per CPU core).")
+        .def("get_conversion_backend", &Settings::GetConversionBackend, "Get the frame conversion backend.")
+        .def("set_conversion_backend", &Settings::SetConversionBackend, py::arg("conversion_backend"), "Set the frame conversion backend.")
         .def("get_video_profile_local_ps4", &Settings::GetVideoProfileLocalPS4, "Get the local PS4 video profile.")
         .def("get_video_profile_remote_ps4", &Settings::GetVideoProfileRemotePS4, "Get the remote PS4 video profile.")
         .def("get_video_profile_local_ps5", &Settings::GetVideoProfileLocalPS5, "Get the local PS5 video profile.")
@@ -354,7 +706,9 @@ PYBIND11_MODULE(chiaki_py, m)
                     << "audioBufferSize=" << s.GetAudioBufferSize() << ", "
                     << "audioOutDevice='" << s.GetAudioOutDevice() << "', "
                     << "audioInDevice='" << s.GetAudioInDevice() << "', "
-                    << "psnAccountId='" << s.GetPsnAccountId() << "'"
+                    << "psnAccountId='" << s.GetPsnAccountId() << "', "
+                    << "conversionThreads=" << s.GetConversionThreads() << ", "
+                    << "conversionBackend=" << static_cast<int>(s.GetConversionBackend())
                     << ")>";
                 return repr.str(); });
 
@@ -377,7 +731,8 @@ PYBIND11_MODULE(chiaki_py, m)
              py::arg("duid"), py::arg("auto_regist"), py::arg("fullscreen"),
              py::arg("zoom"), py::arg("stretch"));
 
-    py::class_<StreamSession>(m, "StreamSession")
+    py::class_<StreamSession> stream_session(m, "StreamSession");
+    stream_session
         .def(py::init<const StreamSessionConnectInfo &>(), py::arg("connect_info"))
         .def("start", &StreamSession::Start, "Start the stream session.")
         .def("stop", &StreamSession::Stop, "Stop the stream session.")
@@ -393,7 +748,78 @@ PYBIND11_MODULE(chiaki_py, m)
         .def("set_audio_volume", &StreamSession::SetAudioVolume, py::arg("volume"), "Set the audio volume.")
         .def("get_cant_display", &StreamSession::GetCantDisplay, "Get the cant display status.")
         .def("get_ffmpeg_decoder", &StreamSession::GetFfmpegDecoder, "Get the FFmpeg decoder.")
+        .def("get_frames", &get_frames,
+             py::arg("target").noconvert(),
+             py::arg("output_format") = FrameFormat::RGB24,
+             py::arg("roi") = py::none(),
+             py::arg("size") = py::none(),
+             py::arg("timeout_ms") = 1000,
+             py::arg("disable_zero_copy") = false,
+             "Fill the (N, H, W, C) target with the next N decoded frames, waiting at most timeout_ms in total. "
+             "Frames decoded while a previous one is converted are skipped. Returns the number of frames written.")
+        .def("wait_for_frame", [](StreamSession &session, int timeout_ms)
+             { return session.GetLatestFrameSlot()->WaitForFrame(std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms)); },
+             py::arg("timeout_ms"), py::call_guard<py::gil_scoped_release>(),
+             "Wait until a frame was decoded that was not read yet, return False on timeout.")
+        .def("set_every_nth_frame", &StreamSession::SetEveryNthFrame, py::arg("n"),
+             "Only deliver every n-th decoded frame to readers and frame events, 0 or 1 delivers all of them.")
+        .def("get_every_nth_frame", &StreamSession::GetEveryNthFrame, "Get the frame delivery divisor.")
+        .def("set_max_delivery_fps", &StreamSession::SetMaxDeliveryFps, py::arg("fps"),
+             "Deliver at most fps frames per second to readers and frame events, 0 disables the limit. "
+             "Every frame is still decoded, skipped frames are just not converted or announced.")
+        .def("get_max_delivery_fps", &StreamSession::GetMaxDeliveryFps, "Get the maximum frame delivery rate.")
+        .def("get_skipped_frame_count", &StreamSession::GetSkippedFrameCount, "Get the number of decoded frames that were not delivered.")
+        .def("set_suppress_duplicates", &StreamSession::SetSuppressDuplicates, py::arg("enabled"), py::arg("max_distance") = 0,
+             "Skip frames whose perceptual hash differs from the last delivered frame in at most max_distance bits. "
+             "Hardware frames are transferred to system memory for hashing while this is enabled.")
+        .def("get_suppress_duplicates", &StreamSession::GetSuppressDuplicates, "Check if duplicate frames are suppressed.")
+        .def("get_duplicate_frame_count", &StreamSession::GetDuplicateFrameCount, "Get the number of frames skipped as duplicates.")
+        .def("add_change_region", &StreamSession::AddChangeRegion,
+             py::arg("x"), py::arg("y"), py::arg("width"), py::arg("height"), py::arg("threshold") = 8.0,
+             "Watch a rectangle of every decoded frame, including those the decimation skips, and return its id. on_region_changed fires when the mean absolute "
+             "luma difference to its last reported state exceeds threshold (0 - 255).")
+        .def("remove_change_region", &StreamSession::RemoveChangeRegion, py::arg("id"), "Stop watching a region, return False if the id is unknown.")
+        .def("clear_change_regions", &StreamSession::ClearChangeRegions, "Stop watching all regions.")
+        .def("start_shm_sink", &StreamSession::StartShmSink,
+             py::arg("name"),
+             py::arg("output_format") = FrameFormat::BGR24,
+             py::arg("width") = 0,
+             py::arg("height") = 0,
+             py::arg("slot_count") = 4,
+             py::call_guard<py::gil_scoped_release>(),
+             "Publish every frame, converted to output_format and width x height (0 = stream resolution), into the named shared memory ring. "
+             "Other processes read it with ShmFrameReader.")
+        .def("stop_shm_sink", &StreamSession::StopShmSink, py::call_guard<py::gil_scoped_release>(), "Stop publishing frames into shared memory and remove the ring.")
+        .def("start_recording", &StreamSession::StartRecording, py::arg("path"), py::arg("format") = "",
+             py::call_guard<py::gil_scoped_release>(),
+             "Record the video stream into path (e.g. .mkv or .mp4) by remuxing it on a background thread, without decoding. "
+             "The container is picked from format or the extension of path. Recording starts at the next keyframe.")
+        .def("stop_recording", &StreamSession::StopRecording, py::call_guard<py::gil_scoped_release>(),
+             "Finish the recording. Raises if writing the file failed.")
+        .def("is_recording", &StreamSession::IsRecording, "Check if the video stream is being recorded.")
+        .def("set_keyframe_only", &StreamSession::SetKeyframeOnly, py::arg("enabled"), py::arg("min_interval") = 0.0,
+             "Only decode intra coded samples, at most one every min_interval seconds if it is positive. "
+             "With an interval, a keyframe is requested from the console whenever it passes without one. "
+             "Recording, replay and on_video_sample still see every sample.")
+        .def("get_keyframe_only", &StreamSession::GetKeyframeOnly, "Check if only keyframes are decoded.")
+        .def("get_undecoded_sample_count", &StreamSession::GetUndecodedSampleCount, "Get the number of samples skipped by the keyframe only mode.")
+        .def("get_keyframe_request_count", &StreamSession::GetKeyframeRequestCount, "Get the number of keyframes requested by the keyframe only mode.")
+        .def("enable_replay", &StreamSession::EnableReplay, py::arg("seconds") = 30.0, py::arg("max_bytes") = 256 * 1024 * 1024,
+             py::call_guard<py::gil_scoped_release>(),
+             "Keep the last seconds of the compressed video stream in memory, trimmed at keyframes and capped at max_bytes.")
+        .def("disable_replay", &StreamSession::DisableReplay, py::call_guard<py::gil_scoped_release>(),
+             "Stop buffering the video stream and drop the buffered video.")
+        .def("dump_replay", &StreamSession::DumpReplay, py::arg("path"), py::arg("format") = "",
+             py::call_guard<py::gil_scoped_release>(),
+             "Write the buffered video into path in the background, without decoding it. "
+             "on_replay_dumped reports the path when it is done, or an error.")
+        .def("get_replay_seconds", &StreamSession::GetReplaySeconds, "Get the duration of the buffered video in seconds.")
+        .def("get_dropped_event_count", &StreamSession::GetDroppedEventCount, "Get the number of events Python never received, dropped by the backpressure policies or coalesced into a newer one.")
+        .def("latest_frame", &pull_frame, py::arg("disable_zero_copy") = false, py::arg("output_format") = py::none(), "Get the latest decoded frame (converted to output_format if given), or None if there was no new frame since the last call.")
         .def("on_frame_available", &StreamSession::OnFfmpegFrameAvailable, "Retrieve the FFmpeg frame available event.", py::return_value_policy::reference)
+        .def("on_video_sample", &StreamSession::OnVideoSample, "Retrieve the compressed video sample event.", py::return_value_policy::reference)
+        .def("on_replay_dumped", &StreamSession::OnReplayDumped, "Retrieve the replay dumped event.", py::return_value_policy::reference)
+        .def("on_region_changed", &StreamSession::OnRegionChanged, "Retrieve the region changed event.", py::return_value_policy::reference)
         .def("on_session_quit", &StreamSession::OnSessionQuit, "Retrieve the session quit event.", py::return_value_policy::reference)
         .def("on_login_pin_requested", &StreamSession::OnLoginPINRequested, "Retrieve the login PIN requested event.", py::return_value_policy::reference)
         .def("on_data_holepunch_progress", &StreamSession::OnDataHolepunchProgress, "Retrieve the data holepunch progress event.", py::return_value_policy::reference)
@@ -460,6 +886,11 @@ PYBIND11_MODULE(chiaki_py, m)
         .def("set_orientation", &StreamSession::setOrientation, py::arg("x"), py::arg("y"), py::arg("z"), py::arg("w"), "Set the orientation x, y, z and w value [0, 1023].")
 
         .def("send_feedback_state", &StreamSession::SendFeedbackState, "Send the feedback state.");
+#ifdef CHIAKI_PY_TEST_HOOKS
+    stream_session.def("_emit_test_events", &StreamSession::EmitTestEvents, py::arg("frame_count"), py::arg("thread_count") = 1, py::arg("quit") = false,
+                       py::call_guard<py::gil_scoped_release>(),
+                       "For tests: emit frame_count frame available events from each of thread_count native threads, then a session quit if quit is set.");
+#endif
 
     py::class_<DiscoveryHostWrapper>(m, "DiscoveryHost")
         .def(py::init<>())
@@ -24,7 +24,11 @@ void init_core_bitstream(py::module &m)
         .def_property("reference_frame", &BitstreamWrapper::get_codec, &BitstreamWrapper::set_codec, "The reference frame.")
         .def_property("slice_type", &BitstreamWrapper::get_log2_max_frame_num_minus4, &BitstreamWrapper::set_log2_max_frame_num_minus4, "The slice type.")
         .def_property("reference_frame", &BitstreamWrapper::get_log2_max_pic_order_cnt_lsb_minus4, &BitstreamWrapper::set_log2_max_pic_order_cnt_lsb_minus4, "The reference frame.")
-        .def("header", &BitstreamWrapper::header, py::arg("data"), "Parses the header from the given data.")
-        .def("slice", &BitstreamWrapper::slice, py::arg("data"), py::arg("slice"), "Parses the slice from the given data.")
-        .def("slice_set_reference_frame", &BitstreamWrapper::slice_set_reference_frame, py::arg("data"), py::arg("reference_frame"), "Sets the reference frame.");
+        // Buffer overloads come first, otherwise memoryviews would be copied into a list
+        .def("header", py::overload_cast<py::buffer>(&BitstreamWrapper::header), py::arg("data"), "Parses the header from the given buffer without copying it.")
+        .def("header", py::overload_cast<std::vector<uint8_t> &>(&BitstreamWrapper::header), py::arg("data"), "Parses the header from the given data.")
+        .def("slice", py::overload_cast<py::buffer, BitstreamSliceWrapper &>(&BitstreamWrapper::slice), py::arg("data"), py::arg("slice"), "Parses the slice from the given buffer without copying it.")
+        .def("slice", py::overload_cast<std::vector<uint8_t> &, BitstreamSliceWrapper &>(&BitstreamWrapper::slice), py::arg("data"), py::arg("slice"), "Parses the slice from the given data.")
+        .def("slice_set_reference_frame", py::overload_cast<py::buffer, unsigned>(&BitstreamWrapper::slice_set_reference_frame), py::arg("data"), py::arg("reference_frame"), "Sets the reference frame in the given writable buffer.")
+        .def("slice_set_reference_frame", py::overload_cast<std::vector<uint8_t> &, unsigned>(&BitstreamWrapper::slice_set_reference_frame), py::arg("data"), py::arg("reference_frame"), "Sets the reference frame.");
 }
\ No newline at end of file
@@ -0,0 +1,291 @@
+#include "event_dispatcher.h"
+
+#include <pybind11/pybind11.h>
+
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <vector>
+#include <map>
+#include <algorithm>
+
+namespace py = pybind11;
+
+/**
+ * Bounded queue after Dmitry Vyukov: every cell carries a sequence number that tells producers and the consumer
+ * whose turn it is, so producers only contend on enqueue_pos. The mutex is only taken to put the idle
+ * dispatch thread to sleep and to wake it up.
+ */
+struct EventDispatcher::Queue
+{
+    struct Cell
+    {
+        std::atomic<size_t> sequence;
+        Event event;
+    };
+
+    std::unique_ptr<Cell[]> cells;
+    size_t mask;
+    size_t batch_size;
+    std::atomic<size_t> enqueue_pos{0};
+    size_t dequeue_pos = 0; // Only touched by the dispatch thread
+
+    std::atomic<bool> sleeping{false};
+    std::atomic<bool> stopping{false};
+    std::atomic<bool> detached{false};
+    std::atomic<uint64_t> dropped{0};
+    std::mutex mutex;
+    std::condition_variable cond;
+
+    /** Delayed events, guarded by mutex, timer_count lets the dispatch thread skip the lock while it is empty */
+    std::multimap<std::chrono::steady_clock::time_point, Event> timers;
+    std::atomic<size_t> timer_count{0};
+
+    Queue(size_t capacity, size_t batch_size) : batch_size(std::max<size_t>(1, batch_size))
+    {
+        size_t size = 2;
+        while (size < capacity)
+            size <<= 1;
+        cells.reset(new Cell[size]);
+        for (size_t i = 0; i < size; i++)
+            cells[i].sequence.store(i, std::memory_order_relaxed);
+        mask = size - 1;
+    }
+
+    bool Push(Event &event)
+    {
+        Cell *cell;
+        size_t pos = enqueue_pos.load(std::memory_order_relaxed);
+        while (true)
+        {
+            cell = &cells[pos & mask];
+            size_t sequence = cell->sequence.load(std::memory_order_acquire);
+            intptr_t diff = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(pos);
+            if (diff == 0)
+            {
+                if (enqueue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                    break;
+            }
+            else if (diff < 0)
+                return false;
+            else
+                pos = enqueue_pos.load(std::memory_order_relaxed);
+        }
+        cell->event = std::move(event);
+        // Sequentially consistent with sleeping in Wait(), either the consumer sees the event or we see it sleeping
+        cell->sequence.store(pos + 1, std::memory_order_seq_cst);
+        if (sleeping.load(std::memory_order_seq_cst))
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            cond.notify_one();
+        }
+        return true;
+    }
+
+    bool HasPending(std::memory_order order = std::memory_order_acquire) const
+    {
+        return cells[dequeue_pos & mask].sequence.load(order) == dequeue_pos + 1;
+    }
+
+    bool Pop(Event &event)
+    {
+        if (!HasPending())
+            return false;
+        Cell &cell = cells[dequeue_pos & mask];
+        event = std::move(cell.event);
+        cell.event = nullptr;
+        cell.sequence.store(dequeue_pos + mask + 1, std::memory_order_release);
+        dequeue_pos++;
+        return true;
+    }
+
+    bool PushAt(Event &event, std::chrono::steady_clock::time_point when)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (stopping)
+            return false;
+        timers.emplace(when, std::move(event));
+        timer_count.store(timers.size(), std::memory_order_relaxed);
+        // The dispatch thread may sleep until a later timer, or without any
+        cond.notify_one();
+        return true;
+    }
+
+    void PopDue(std::vector<Event> &batch)
+    {
+        if (!timer_count.load(std::memory_order_relaxed))
+            return;
+        auto now = std::chrono::steady_clock::now();
+        std::lock_guard<std::mutex> lock(mutex);
+        while (!timers.empty() && timers.begin()->first <= now && batch.size() < batch_size)
+        {
+            batch.push_back(std::move(timers.begin()->second));
+            timers.erase(timers.begin());
+        }
+        timer_count.store(timers.size(), std::memory_order_relaxed);
+    }
+
+    // Returns on a new event, a new timer, the next due timer or a spurious wakeup, Run() checks again anyway
+    void Wait()
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        sleeping.store(true, std::memory_order_seq_cst);
+        if (!stopping.load() && !HasPending(std::memory_order_seq_cst))
+        {
+            if (timers.empty())
+                cond.wait(lock);
+            else if (timers.begin()->first > std::chrono::steady_clock::now())
+                cond.wait_until(lock, timers.begin()->first);
+        }
+        sleeping.store(false, std::memory_order_relaxed);
+    }
+};
+
+// Detached flag of the dispatcher running on this thread, if any
+static thread_local const std::atomic<bool> *current_detached = nullptr;
+
+EventDispatcher::EventDispatcher(size_t capacity, size_t batch_size)
+    : queue(std::make_shared<Queue>(capacity, batch_size))
+{
+    // The thread owns a reference to the queue, so it survives a dispatcher destroyed by one of its events
+    thread = std::thread(&EventDispatcher::Run, queue);
+    thread_id = thread.get_id();
+}
+
+EventDispatcher::~EventDispatcher()
+{
+    Stop();
+}
+
+bool EventDispatcher::Post(Event event)
+{
+    if (queue->stopping.load(std::memory_order_relaxed) || !queue->Push(event))
+    {
+        queue->dropped.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+    return true;
+}
+
+bool EventDispatcher::PostAt(Event event, std::chrono::steady_clock::time_point when)
+{
+    if (!queue->PushAt(event, when))
+    {
+        queue->dropped.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+    return true;
+}
+
+void EventDispatcher::Stop()
+{
+    if (!thread.joinable())
+        return;
+
+    {
+        std::lock_guard<std::mutex> lock(queue->mutex);
+        queue->stopping = true;
+    }
+    queue->cond.notify_one();
+
+    if (IsDispatchThread())
+    {
+        queue->detached = true;
+        thread.detach();
+        return;
+    }
+
+    // The remaining events need the GIL to be delivered
+    if (PyGILState_Check())
+    {
+        py::gil_scoped_release release;
+        thread.join();
+    }
+    else
+        thread.join();
+}
+
+// Raises message as a RuntimeError and hands it to sys.unraisablehook, like Python errors of the callbacks
+static void DiscardAsUnraisable(const char *message)
+{
+    PyErr_SetString(PyExc_RuntimeError, message);
+    py::error_already_set error;
+    error.discard_as_unraisable("EventDispatcher");
+}
+
+void EventDispatcher::Invoke(const Event &event)
+{
+    try
+    {
+        event();
+    }
+    catch (py::error_already_set &error)
+    {
+        error.discard_as_unraisable("EventDispatcher");
+    }
+    catch (const std::exception &error)
+    {
+        DiscardAsUnraisable(error.what());
+    }
+    catch (...)
+    {
+        DiscardAsUnraisable("Unknown exception in event callback");
+    }
+}
+
+bool EventDispatcher::IsCurrentDetached()
+{
+    return current_detached && current_detached->load();
+}
+
+bool EventDispatcher::IsStopping() const
+{
+    return queue->stopping.load(std::memory_order_relaxed);
+}
+
+size_t EventDispatcher::GetCapacity() const
+{
+    return queue->mask + 1;
+}
+
+uint64_t EventDispatcher::GetDroppedCount() const
+{
+    return queue->dropped.load(std::memory_order_relaxed);
+}
+
+void EventDispatcher::Run(std::shared_ptr<Queue> queue)
+{
+    current_detached = &queue->detached;
+    std::vector<Event> batch;
+    batch.reserve(queue->batch_size);
+    Event event;
+    while (true)
+    {
+        queue->PopDue(batch);
+        while (batch.size() < queue->batch_size && queue->Pop(event))
+            batch.push_back(std::move(event));
+
+        if (batch.empty())
+        {
+            if (queue->stopping)
+                return;
+            queue->Wait();
+            continue;
+        }
+
+        {
+            py::gil_scoped_acquire gil;
+            for (auto &e : batch)
+            {
+                // Everything the events point to is gone once the dispatcher was destroyed from one of them
+                if (queue->detached)
+                    break;
+                Invoke(e);
+            }
+            batch.clear();
+        }
+
+        if (queue->detached)
+            return;
+    }
+}
@@ -1,4 +1,6 @@
 #include "event_source.h"
+#include "roi_detector.h"
+#include "video_sample.h"
 
 #include <chiaki/session.h>
 
@@ -6,51 +8,63 @@
 
 namespace py = pybind11;
 
+template <typename T>
+static void bind_event_source(py::module &m, const char *name)
+{
+    py::class_<EventSource<T>>(m, name)
+        .def("subscribe", &EventSource<T>::subscribe,
+             py::arg("on_next"),
+             py::arg("on_error") = py::none(),
+             py::arg("on_completed") = py::none())
+        .def("set_policy", &EventSource<T>::set_policy, py::arg("policy"), py::arg("capacity") = 256, py::arg("timeout") = 1.0,
+             "Set what happens when capacity values wait for delivery. timeout is how many seconds Block waits for room, "
+             "0 waits until there is room. Only applies to sources delivered by an event dispatcher.")
+        .def("get_policy", &EventSource<T>::get_policy, "Get the backpressure policy.")
+        .def("get_pending_count", &EventSource<T>::get_pending_count, "Get the number of values waiting for delivery.")
+        .def("get_dropped_count", &EventSource<T>::get_dropped_count, "Get the number of values dropped by the backpressure policy.")
+        .def("get_coalesced_count", &EventSource<T>::get_coalesced_count, "Get the number of values replaced by a newer one before delivery.")
+        .def("set_throttle", &EventSource<T>::set_throttle, py::arg("max_hz") = 0.0, py::arg("min_delta") = 0.0,
+             "Drop values arriving faster than max_hz, or numeric values changing by less than min_delta. "
+             "Both are checked against the last value that was let through, 0 disables the check. "
+             "On session events, the latest value that came too soon is delivered once the interval expired.")
+        .def("get_throttled_count", &EventSource<T>::get_throttled_count, "Get the number of values dropped by the throttle.");
+}
+
 void init_event_source(py::module &m)
 {
+    py::enum_<BackpressurePolicy>(m, "BackpressurePolicy")
+        .value("DropOldest", BackpressurePolicy::DropOldest)
+        .value("DropNewest", BackpressurePolicy::DropNewest)
+        .value("CoalesceLatest", BackpressurePolicy::CoalesceLatest)
+        .value("Block", BackpressurePolicy::Block)
+        .export_values();
 
-    py::class_<EventSource<int>::Subscription>(m, "Subscription")
+    py::class_<EventSource<int>::Subscription, std::shared_ptr<EventSource<int>::Subscription>>(m, "Subscription")
         .def("unsubscribe", &EventSource<int>::Subscription::unsubscribe);
 
-    py::class_<EventSource<ChiakiQuitReason>::Subscription>(m, "ChiakiQuitReasonEventSourceSubscription")
+    py::class_<EventSource<ChiakiQuitReason>::Subscription, std::shared_ptr<EventSource<ChiakiQuitReason>::Subscription>>(m, "ChiakiQuitReasonEventSourceSubscription")
         .def("unsubscribe", &EventSource<ChiakiQuitReason>::Subscription::unsubscribe);
 
-    py::class_<EventSource<bool>::Subscription>(m, "BoolEventSourceSubscription")
+    py::class_<EventSource<bool>::Subscription, std::shared_ptr<EventSource<bool>::Subscription>>(m, "BoolEventSourceSubscription")
         .def("unsubscribe", &EventSource<bool>::Subscription::unsubscribe);
 
-    py::class_<EventSource<double>::Subscription>(m, "DoubleEventSourceSubscription")
+    py::class_<EventSource<double>::Subscription, std::shared_ptr<EventSource<double>::Subscription>>(m, "DoubleEventSourceSubscription")
         .def("unsubscribe", &EventSource<double>::Subscription::unsubscribe);
 
-    py::class_<EventSource<std::string>::Subscription>(m, "StringEventSourceSubscription")
+    py::class_<EventSource<std::string>::Subscription, std::shared_ptr<EventSource<std::string>::Subscription>>(m, "StringEventSourceSubscription")
         .def("unsubscribe", &EventSource<std::string>::Subscription::unsubscribe);
 
-    py::class_<EventSource<ChiakiQuitReason>>(m, "ChiakiQuitReasonEventSource")
-        .def("subscribe", &EventSource<ChiakiQuitReason>::subscribe,
-             py::arg("on_next"),
-             py::arg("on_error") = py::none(),
-             py::arg("on_completed") = py::none(), py::return_value_policy::reference);
-
-    py::class_<EventSource<int>>(m, "EventSource")
-        .def("subscribe", &EventSource<int>::subscribe,
-             py::arg("on_next"),
-             py::arg("on_error") = py::none(),
-             py::arg("on_completed") = py::none());
-
-    py::class_<EventSource<bool>>(m, "BoolEventSource")
-        .def("subscribe", &EventSource<bool>::subscribe,
-             py::arg("on_next"),
-             py::arg("on_error") = py::none(),
-             py::arg("on_completed") = py::none(), py::return_value_policy::reference);
+    py::class_<EventSource<RegionChange>::Subscription, std::shared_ptr<EventSource<RegionChange>::Subscription>>(m, "RegionChangeEventSourceSubscription")
+        .def("unsubscribe", &EventSource<RegionChange>::Subscription::unsubscribe);
 
-    py::class_<EventSource<double>>(m, "DoubleEventSource")
-        .def("subscribe", &EventSource<double>::subscribe,
-             py::arg("on_next"),
-             py::arg("on_error") = py::none(),
-             py::arg("on_completed") = py::none(), py::return_value_policy::reference);
+    py::class_<EventSource<std::shared_ptr<PyVideoSample>>::Subscription, std::shared_ptr<EventSource<std::shared_ptr<PyVideoSample>>::Subscription>>(m, "VideoSampleEventSourceSubscription")
+        .def("unsubscribe", &EventSource<std::shared_ptr<PyVideoSample>>::Subscription::unsubscribe);
 
-    py::class_<EventSource<std::string>>(m, "StringEventSource")
-        .def("subscribe", &EventSource<std::string>::subscribe,
-             py::arg("on_next"),
-             py::arg("on_error") = py::none(),
-             py::arg("on_completed") = py::none(), py::return_value_policy::reference);
-}
\ No newline at end of file
+    bind_event_source<ChiakiQuitReason>(m, "ChiakiQuitReasonEventSource");
+    bind_event_source<int>(m, "EventSource");
+    bind_event_source<bool>(m, "BoolEventSource");
+    bind_event_source<double>(m, "DoubleEventSource");
+    bind_event_source<std::string>(m, "StringEventSource");
+    bind_event_source<RegionChange>(m, "RegionChangeEventSource");
+    bind_event_source<std::shared_ptr<PyVideoSample>>(m, "VideoSampleEventSource");
+}
@@ -0,0 +1,434 @@
+#include "frame_converter.h"
+
+#include <algorithm>
+#include <thread>
+
+extern "C"
+{
+#include <libavutil/hwcontext.h>
+#include <libavutil/imgutils.h>
+#include <libavutil/pixdesc.h>
+}
+
+// Slices start on multiples of this so that subsampled chroma rows are never split
+#define SLICE_ALIGN 16
+// Below this many rows per slice the thread handoff costs more than it saves
+#define SLICE_MIN_HEIGHT 64
+
+// av_frame_copy_props() appends side data to frames that are reused, so only carry over what consumers read
+static void CopyFrameProps(AVFrame *dst, const AVFrame *src)
+{
+    dst->pts = src->pts;
+    dst->pkt_dts = src->pkt_dts;
+    dst->color_range = src->color_range;
+    dst->color_primaries = src->color_primaries;
+    dst->color_trc = src->color_trc;
+    dst->colorspace = src->colorspace;
+    dst->chroma_location = src->chroma_location;
+}
+
+// Plane pointers of an image in format starting at row y
+static void SlicePlanes(AVPixelFormat format, uint8_t *const planes[4], const int linesize[4], int y, uint8_t *data[4])
+{
+    const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get(format);
+    for (int p = 0; p < 4; p++)
+    {
+        if (!planes[p])
+        {
+            data[p] = nullptr;
+            continue;
+        }
+        int shift = (p == 1 || p == 2) ? desc->log2_chroma_h : 0;
+        data[p] = planes[p] + (ptrdiff_t)(y >> shift) * linesize[p];
+    }
+}
+
+// Untagged streams follow the usual convention of BT.709 for HD and BT.601 for SD
+static YuvColorMatrix FrameColorMatrix(const AVFrame *frame)
+{
+    switch (frame->colorspace)
+    {
+    case AVCOL_SPC_BT709:
+        return YuvColorMatrix::BT709;
+    case AVCOL_SPC_BT470BG:
+    case AVCOL_SPC_SMPTE170M:
+    case AVCOL_SPC_FCC:
+        return YuvColorMatrix::BT601;
+    default:
+        return frame->height >= 720 ? YuvColorMatrix::BT709 : YuvColorMatrix::BT601;
+    }
+}
+
+static bool FrameFullRange(const AVFrame *frame)
+{
+    return frame->color_range == AVCOL_RANGE_JPEG;
+}
+
+static bool NativePixelLayout(AVPixelFormat format, RgbPixelLayout *layout)
+{
+    switch (format)
+    {
+    case AV_PIX_FMT_RGB24:
+        *layout = RgbPixelLayout::RGB24;
+        return true;
+    case AV_PIX_FMT_BGR24:
+        *layout = RgbPixelLayout::BGR24;
+        return true;
+    case AV_PIX_FMT_RGBA:
+        *layout = RgbPixelLayout::RGBA;
+        return true;
+    case AV_PIX_FMT_BGRA:
+        *layout = RgbPixelLayout::BGRA;
+        return true;
+    default:
+        return false;
+    }
+}
+
+AVPixelFormat GetFramePixelFormat(FrameFormat format)
+{
+    switch (format)
+    {
+    case FrameFormat::RGB24:
+        return AV_PIX_FMT_RGB24;
+    case FrameFormat::BGR24:
+        return AV_PIX_FMT_BGR24;
+    case FrameFormat::RGBA:
+        return AV_PIX_FMT_RGBA;
+    case FrameFormat::BGRA:
+        return AV_PIX_FMT_BGRA;
+    case FrameFormat::GRAY8:
+        return AV_PIX_FMT_GRAY8;
+    case FrameFormat::NV12:
+        return AV_PIX_FMT_NV12;
+    case FrameFormat::YUV420P:
+        return AV_PIX_FMT_YUV420P;
+    }
+    return AV_PIX_FMT_NONE;
+}
+
+FrameConverter::FrameConverter(size_t pool_size)
+    : backend(ConversionBackend::Swscale),
+      sw_frame(nullptr),
+      crop_frame(nullptr),
+      frame_pool(pool_size ? pool_size : 1, nullptr),
+      frame_pool_next(0)
+{ }
+
+FrameConverter::~FrameConverter()
+{
+    Reset();
+}
+
+void FrameConverter::SetThreadCount(unsigned int thread_count)
+{
+    if (thread_count == 0)
+        thread_count = std::max(1u, std::thread::hardware_concurrency());
+
+    std::lock_guard<std::mutex> lock(mutex);
+    if (thread_count == GetThreadCount())
+        return;
+    workers = thread_count > 1 ? std::make_shared<WorkerPool>(thread_count) : nullptr;
+}
+
+void FrameConverter::ShareWorkers(FrameConverter &other)
+{
+    std::shared_ptr<WorkerPool> pool;
+    {
+        std::lock_guard<std::mutex> lock(other.mutex);
+        pool = other.workers;
+    }
+    std::lock_guard<std::mutex> lock(mutex);
+    workers = std::move(pool);
+}
+
+void FrameConverter::SetBackend(ConversionBackend backend)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    this->backend = backend;
+}
+
+void FrameConverter::Reset()
+{
+    for (auto &scaler : scalers)
+        sws_freeContext(scaler.ctx);
+    scalers.clear();
+    if (sw_frame)
+        av_frame_free(&sw_frame);
+    if (crop_frame)
+        av_frame_free(&crop_frame);
+    for (auto &pool_frame : frame_pool)
+    {
+        if (pool_frame)
+            av_frame_free(&pool_frame);
+    }
+    frame_pool_next = 0;
+}
+
+AVFrame *FrameConverter::TransferHardwareFrame(AVFrame *frame)
+{
+    if (!frame->hw_frames_ctx)
+        return frame;
+
+    // A crop view of the previous download would keep its buffers from being reused
+    if (crop_frame)
+        av_frame_unref(crop_frame);
+
+    if (!sw_frame)
+    {
+        sw_frame = av_frame_alloc();
+        if (!sw_frame)
+            return nullptr;
+    }
+
+    // Download into the previous buffers if nobody else holds a reference to them,
+    // otherwise let av_hwframe_transfer_data() allocate fresh ones in the same format.
+    if (sw_frame->buf[0] && (sw_frame->width != frame->width || sw_frame->height != frame->height || !av_frame_is_writable(sw_frame)))
+    {
+        int format = sw_frame->format;
+        av_frame_unref(sw_frame);
+        sw_frame->format = format;
+    }
+
+    if (av_hwframe_transfer_data(sw_frame, frame, 0) < 0)
+    {
+        av_frame_unref(sw_frame);
+        return nullptr;
+    }
+
+    CopyFrameProps(sw_frame, frame);
+    return sw_frame;
+}
+
+AVFrame *FrameConverter::Crop(const AVFrame *frame, int x, int y, int width, int height)
+{
+    const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get((AVPixelFormat)frame->format);
+    if (!desc || (desc->flags & AV_PIX_FMT_FLAG_HWACCEL))
+        return nullptr;
+
+    x &= ~((1 << desc->log2_chroma_w) - 1);
+    y &= ~((1 << desc->log2_chroma_h) - 1);
+    if (x < 0 || y < 0 || width <= 0 || height <= 0 || width > frame->width - x || height > frame->height - y)
+        return nullptr;
+
+    if (!crop_frame)
+    {
+        crop_frame = av_frame_alloc();
+        if (!crop_frame)
+            return nullptr;
+    }
+
+    av_frame_unref(crop_frame);
+    if (av_frame_ref(crop_frame, frame) < 0)
+        return nullptr;
+
+    // The convention for untagged streams goes by the size of the picture, which the crop must not change
+    if (crop_frame->colorspace == AVCOL_SPC_UNSPECIFIED)
+        crop_frame->colorspace = FrameColorMatrix(frame) == YuvColorMatrix::BT709 ? AVCOL_SPC_BT709 : AVCOL_SPC_SMPTE170M;
+
+    crop_frame->crop_left = x;
+    crop_frame->crop_top = y;
+    crop_frame->crop_right = frame->width - x - width;
+    crop_frame->crop_bottom = frame->height - y - height;
+    if (av_frame_apply_cropping(crop_frame, AV_FRAME_CROP_UNALIGNED) < 0)
+    {
+        av_frame_unref(crop_frame);
+        return nullptr;
+    }
+    return crop_frame;
+}
+
+AVFrame *FrameConverter::Convert(const AVFrame *frame, AVPixelFormat dst_format)
+{
+    AVFrame *dst_frame = NextPoolFrame(frame->width, frame->height, dst_format);
+    if (!dst_frame)
+        return nullptr;
+
+    if (!ConvertNative(frame, dst_frame->data, dst_frame->linesize, dst_format) &&
+        !Scale(frame, dst_frame->data, dst_frame->linesize, dst_format, frame->width, frame->height))
+        return nullptr;
+
+    CopyFrameProps(dst_frame, frame);
+    return dst_frame;
+}
+
+bool FrameConverter::ConvertToBuffer(const AVFrame *frame, AVPixelFormat dst_format, int dst_width, int dst_height, uint8_t *buffer, size_t buffer_size)
+{
+    int size = av_image_get_buffer_size(dst_format, dst_width, dst_height, 1);
+    if (size <= 0 || (size_t)size > buffer_size)
+        return false;
+
+    uint8_t *dst_data[4];
+    int dst_linesize[4];
+    if (av_image_fill_arrays(dst_data, dst_linesize, buffer, dst_format, dst_width, dst_height, 1) < 0)
+        return false;
+
+    bool resize = dst_width != frame->width || dst_height != frame->height;
+    if (!resize && ConvertNative(frame, dst_data, dst_linesize, dst_format))
+        return true;
+    return Scale(frame, dst_data, dst_linesize, dst_format, dst_width, dst_height);
+}
+
+bool FrameConverter::ConvertNative(const AVFrame *src, uint8_t *const dst_data[4], const int dst_linesize[4], AVPixelFormat dst_format)
+{
+    if (backend != ConversionBackend::Native)
+        return false;
+
+    YuvImage yuv;
+    if (src->format == AV_PIX_FMT_NV12)
+        yuv.chroma = YuvChromaLayout::NV12;
+    else if (src->format == AV_PIX_FMT_YUV420P)
+        yuv.chroma = YuvChromaLayout::YUV420P;
+    else
+        return false;
+
+    RgbImage rgb;
+    if (!NativePixelLayout(dst_format, &rgb.layout))
+        return false;
+    rgb.data = dst_data[0];
+    rgb.stride = dst_linesize[0];
+
+    for (int p = 0; p < 3; p++)
+    {
+        yuv.planes[p] = src->data[p];
+        yuv.strides[p] = src->linesize[p];
+    }
+    yuv.width = src->width;
+    yuv.height = src->height;
+    yuv.matrix = FrameColorMatrix(src);
+    yuv.full_range = FrameFullRange(src);
+
+    int slice_count = SliceCount(yuv.height);
+    if (slice_count <= 1)
+    {
+        ConvertYuvToRgb(yuv, rgb, 0, yuv.height);
+        return true;
+    }
+
+    int slice_height = FFALIGN((yuv.height + slice_count - 1) / slice_count, SLICE_ALIGN);
+    slice_count = (yuv.height + slice_height - 1) / slice_height;
+    workers->Run(slice_count, [&](int i)
+                 {
+        int y = i * slice_height;
+        ConvertYuvToRgb(yuv, rgb, y, std::min(y + slice_height, yuv.height)); });
+    return true;
+}
+
+bool FrameConverter::Scale(const AVFrame *src, uint8_t *const dst_data[4], const int dst_linesize[4], AVPixelFormat dst_format, int dst_width, int dst_height)
+{
+    AVPixelFormat src_format = (AVPixelFormat)src->format;
+    int width = src->width;
+    int height = src->height;
+    YuvColorMatrix matrix = FrameColorMatrix(src);
+    bool full_range = FrameFullRange(src);
+
+    // Resizing filters read across slice borders, so those frames are scaled in one piece
+    bool resize = dst_width != width || dst_height != height;
+    int slice_count = resize ? 1 : SliceCount(height);
+    if (slice_count <= 1)
+    {
+        SwsContext *scaler = GetScaler(ScalerKey{width, height, src_format, dst_width, dst_height, dst_format, matrix, full_range}, 0);
+        if (!scaler)
+            return false;
+        sws_scale(
+            scaler,
+            src->data, src->linesize, 0, height,
+            dst_data, dst_linesize);
+        return true;
+    }
+
+    // Every slice is converted as an image of its own, so the scalers never see rows out of order.
+    // Scalers are created up front to keep sws_getContext() off the workers.
+    int slice_height = FFALIGN((height + slice_count - 1) / slice_count, SLICE_ALIGN);
+    slice_count = (height + slice_height - 1) / slice_height;
+    for (int i = 0; i < slice_count; i++)
+    {
+        int rows = std::min(slice_height, height - i * slice_height);
+        if (!GetScaler(ScalerKey{width, rows, src_format, width, rows, dst_format, matrix, full_range}, i))
+            return false;
+    }
+
+    workers->Run(slice_count, [&](int i)
+                 {
+        int y = i * slice_height;
+        int rows = std::min(slice_height, height - y);
+        uint8_t *src_slice[4];
+        uint8_t *dst_slice[4];
+        SlicePlanes(src_format, src->data, src->linesize, y, src_slice);
+        SlicePlanes(dst_format, dst_data, dst_linesize, y, dst_slice);
+        sws_scale(
+            scalers[i].ctx,
+            src_slice, src->linesize, 0, rows,
+            dst_slice, dst_linesize); });
+    return true;
+}
+
+int FrameConverter::SliceCount(int height) const
+{
+    if (!workers)
+        return 1;
+    return std::max(1, std::min((int)workers->GetThreadCount(), height / SLICE_MIN_HEIGHT));
+}
+
+SwsContext *FrameConverter::GetScaler(const ScalerKey &key, size_t slot)
+{
+    if (slot >= scalers.size())
+        scalers.resize(slot + 1, CachedScaler{ScalerKey{0, 0, AV_PIX_FMT_NONE, 0, 0, AV_PIX_FMT_NONE, YuvColorMatrix::BT601, false}, nullptr});
+
+    CachedScaler &scaler = scalers[slot];
+    if (scaler.ctx && scaler.key == key)
+        return scaler.ctx;
+
+    if (scaler.ctx)
+        sws_freeContext(scaler.ctx);
+
+    scaler.ctx = sws_getContext(
+        key.width, key.height, key.src_format,
+        key.dst_width, key.dst_height, key.dst_format,
+        SWS_BILINEAR, nullptr, nullptr, nullptr);
+    if (!scaler.ctx)
+    {
+        scaler.key = ScalerKey{0, 0, AV_PIX_FMT_NONE, 0, 0, AV_PIX_FMT_NONE, YuvColorMatrix::BT601, false};
+        return nullptr;
+    }
+
+    // swscale assumes limited range BT.601 input unless told otherwise, RGB output is always full range
+    const AVPixFmtDescriptor *src_desc = av_pix_fmt_desc_get(key.src_format);
+    if (src_desc && !(src_desc->flags & AV_PIX_FMT_FLAG_RGB))
+    {
+        const int *coefficients = sws_getCoefficients(key.matrix == YuvColorMatrix::BT709 ? SWS_CS_ITU709 : SWS_CS_ITU601);
+        const AVPixFmtDescriptor *dst_desc = av_pix_fmt_desc_get(key.dst_format);
+        bool dst_full_range = (dst_desc && (dst_desc->flags & AV_PIX_FMT_FLAG_RGB)) || key.full_range;
+        sws_setColorspaceDetails(scaler.ctx, coefficients, key.full_range, coefficients, dst_full_range, 0, 1 << 16, 1 << 16);
+    }
+    scaler.key = key;
+    return scaler.ctx;
+}
+
+AVFrame *FrameConverter::NextPoolFrame(int width, int height, AVPixelFormat format)
+{
+    AVFrame *&pool_frame = frame_pool[frame_pool_next];
+    frame_pool_next = (frame_pool_next + 1) % frame_pool.size();
+
+    if (!pool_frame)
+    {
+        pool_frame = av_frame_alloc();
+        if (!pool_frame)
+            return nullptr;
+    }
+
+    // Reuse the buffers unless the geometry changed or they are still referenced elsewhere
+    if (pool_frame->buf[0] && pool_frame->width == width && pool_frame->height == height && pool_frame->format == format && av_frame_is_writable(pool_frame))
+        return pool_frame;
+
+    av_frame_unref(pool_frame);
+    pool_frame->format = format;
+    pool_frame->width = width;
+    pool_frame->height = height;
+    if (av_frame_get_buffer(pool_frame, 0) < 0)
+    {
+        av_frame_unref(pool_frame);
+        return nullptr;
+    }
+    return pool_frame;
+}
@@ -0,0 +1,52 @@
+#include "frame_hash.h"
+
+#include <algorithm>
+
+#define HASH_COLUMNS 9
+#define HASH_ROWS 8
+// Samples averaged per cell in each direction, enough to be stable against noise without reading the whole frame
+#define CELL_SAMPLES 4
+
+uint64_t ComputeFrameHash(const LumaPlane &plane)
+{
+    uint32_t cells[HASH_ROWS][HASH_COLUMNS];
+    for (int row = 0; row < HASH_ROWS; row++)
+    {
+        int y0 = row * plane.height / HASH_ROWS;
+        int cell_height = std::max(1, (row + 1) * plane.height / HASH_ROWS - y0);
+        for (int column = 0; column < HASH_COLUMNS; column++)
+        {
+            int x0 = column * plane.width / HASH_COLUMNS;
+            int cell_width = std::max(1, (column + 1) * plane.width / HASH_COLUMNS - x0);
+
+            uint32_t sum = 0;
+            for (int sy = 0; sy < CELL_SAMPLES; sy++)
+            {
+                int y = std::min(plane.height - 1, y0 + (2 * sy + 1) * cell_height / (2 * CELL_SAMPLES));
+                for (int sx = 0; sx < CELL_SAMPLES; sx++)
+                {
+                    int x = std::min(plane.width - 1, x0 + (2 * sx + 1) * cell_width / (2 * CELL_SAMPLES));
+                    sum += plane.At(x, y);
+                }
+            }
+            cells[row][column] = sum;
+        }
+    }
+
+    uint64_t hash = 0;
+    for (int row = 0; row < HASH_ROWS; row++)
+    {
+        for (int column = 0; column < HASH_COLUMNS - 1; column++)
+            hash = (hash << 1) | (cells[row][column] < cells[row][column + 1] ? 1 : 0);
+    }
+    return hash;
+}
+
+bool FrameHasher::Compute(const AVFrame *frame, uint64_t *hash)
+{
+    LumaPlane plane;
+    if (!plane.Init(frame) || plane.width <= 0 || plane.height <= 0)
+        return false;
+    *hash = ComputeFrameHash(plane);
+    return true;
+}
@@ -0,0 +1,87 @@
+#include "keyframe_filter.h"
+#include "nal_parser.h"
+
+#include <algorithm>
+
+KeyframeFilter::KeyframeFilter(ChiakiLog *log, ChiakiCodec codec)
+    : hevc(chiaki_codec_is_h265(codec)),
+      has_header(false),
+      last_decoded_us(0),
+      last_request_us(0),
+      enabled(false),
+      min_interval_us(0),
+      dropped(0),
+      requested(0)
+{
+    chiaki_bitstream_init(&bitstream, log, codec);
+}
+
+void KeyframeFilter::UpdateHeader(uint8_t *buf, size_t buf_size)
+{
+    // The slice parser needs the SPS, keyframes carry it in front of their slices
+    int sps_type = hevc ? 33 : 7;
+    ForEachNalUnit(buf, buf_size, [&](const uint8_t *nal, size_t nal_size)
+                   {
+        // Every unit follows a 3 byte start code inside buf, which the parser expects to see
+        if (nal_size && GetNalUnitType(nal, hevc) == sps_type &&
+            chiaki_bitstream_header(&bitstream, const_cast<uint8_t *>(nal) - 3, static_cast<unsigned>(nal_size + 3)))
+        {
+            has_header = true;
+        } });
+}
+
+bool KeyframeFilter::IsIntra(uint8_t *buf, size_t buf_size)
+{
+    ChiakiBitstreamSlice slice;
+    if (has_header && chiaki_bitstream_slice(&bitstream, buf, static_cast<unsigned>(buf_size), &slice) &&
+        slice.slice_type != CHIAKI_BITSTREAM_SLICE_UNKNOWN)
+    {
+        return slice.slice_type == CHIAKI_BITSTREAM_SLICE_I;
+    }
+    return ParseVideoSample(buf, buf_size, hevc, nullptr);
+}
+
+bool KeyframeFilter::Select(uint8_t *buf, size_t buf_size, int64_t now_us)
+{
+    bool is_enabled = enabled.load(std::memory_order_relaxed);
+    // The SPS is usually only sent once at the start, so it is picked up even while the mode is off
+    if (is_enabled || !has_header)
+        UpdateHeader(buf, buf_size);
+    if (!is_enabled)
+        return true;
+
+    if (!IsIntra(buf, buf_size))
+    {
+        dropped.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+
+    int64_t interval = min_interval_us.load(std::memory_order_relaxed);
+    if (interval > 0 && last_decoded_us && now_us - last_decoded_us < interval)
+    {
+        dropped.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+    last_decoded_us = now_us;
+    return true;
+}
+
+bool KeyframeFilter::TakeKeyframeRequest(int64_t now_us)
+{
+    int64_t interval = min_interval_us.load(std::memory_order_relaxed);
+    if (!enabled.load(std::memory_order_relaxed) || interval <= 0)
+        return false;
+
+    // Counted from the last intra sample or request, whichever is later, so an unanswered request is repeated
+    int64_t since = std::max(last_decoded_us, last_request_us);
+    if (!since)
+    {
+        last_request_us = now_us;
+        return false;
+    }
+    if (now_us - since < interval)
+        return false;
+    last_request_us = now_us;
+    requested.fetch_add(1, std::memory_order_relaxed);
+    return true;
+}
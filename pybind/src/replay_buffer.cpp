@@ -0,0 +1,183 @@
+#include "replay_buffer.h"
+#include "nal_parser.h"
+#include "video_muxer.h"
+#include "frame_info.h"
+
+#include <stdexcept>
+
+ReplayBuffer::ReplayBuffer(ChiakiCodec codec, int width, int height, int64_t max_duration_us, size_t max_bytes,
+                           std::function<void()> request_keyframe)
+    : codec(codec),
+      hevc(chiaki_codec_is_h265(codec)),
+      width(width),
+      height(height),
+      max_duration_us(max_duration_us),
+      max_bytes(max_bytes),
+      request_keyframe(std::move(request_keyframe)),
+      last_request_us(0),
+      front_index(0),
+      buffered_bytes(0),
+      stopping(false)
+{
+    dump_thread = std::thread([this]()
+                              { RunDumps(); });
+}
+
+ReplayBuffer::~ReplayBuffer()
+{
+    {
+        std::lock_guard<std::mutex> lock(dump_mutex);
+        stopping = true;
+    }
+    dump_cond.notify_one();
+    if (dump_thread.joinable())
+        dump_thread.join();
+}
+
+void ReplayBuffer::PushVideoSample(const uint8_t *buf, size_t buf_size, int32_t frames_lost, bool frame_recovered)
+{
+    int64_t time_us = FrameClockNs() / 1000;
+    std::vector<uint8_t> sample_parameter_sets;
+    bool keyframe = ParseVideoSample(buf, buf_size, hevc, &sample_parameter_sets);
+
+    bool needs_keyframe;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!sample_parameter_sets.empty())
+            parameter_sets.swap(sample_parameter_sets);
+
+        // Samples after lost frames reference pictures that are gone, start over at the next keyframe
+        if (frames_lost > 0)
+            Clear();
+
+        // Without a keyframe to start from, the samples could not be decoded anyway
+        if (!samples.empty() || keyframe)
+        {
+            if (keyframe)
+                keyframes.push_back(front_index + samples.size());
+            samples.push_back(Sample{std::make_shared<const std::vector<uint8_t>>(buf, buf + buf_size), time_us, keyframe});
+            buffered_bytes += buf_size;
+            Trim();
+        }
+        needs_keyframe = NeedsKeyframe(time_us);
+    }
+
+    if (needs_keyframe && request_keyframe && time_us - last_request_us >= KEYFRAME_REQUEST_INTERVAL_US)
+    {
+        last_request_us = time_us;
+        request_keyframe();
+    }
+}
+
+bool ReplayBuffer::NeedsKeyframe(int64_t now_us) const
+{
+    if (samples.empty())
+        return true;
+    // Trim() can only drop the oldest group of pictures once a newer keyframe arrived
+    return keyframes.size() == 1 && max_duration_us > 0 && now_us - samples.front().time_us >= max_duration_us;
+}
+
+void ReplayBuffer::Trim()
+{
+    while (keyframes.size() > 1)
+    {
+        uint64_t next = keyframes[1];
+        const Sample &next_sample = samples[next - front_index];
+        bool too_long = max_duration_us > 0 && samples.back().time_us - next_sample.time_us >= max_duration_us;
+        bool too_big = max_bytes > 0 && buffered_bytes > max_bytes;
+        if (!too_long && !too_big)
+            return;
+
+        while (front_index < next)
+        {
+            buffered_bytes -= samples.front().data->size();
+            samples.pop_front();
+            front_index++;
+        }
+        keyframes.pop_front();
+    }
+
+    if (max_bytes > 0 && buffered_bytes > max_bytes)
+        Clear();
+}
+
+void ReplayBuffer::Clear()
+{
+    front_index += samples.size();
+    samples.clear();
+    keyframes.clear();
+    buffered_bytes = 0;
+}
+
+double ReplayBuffer::GetBufferedSeconds()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    if (samples.empty())
+        return 0.0;
+    return static_cast<double>(samples.back().time_us - samples.front().time_us) / 1e6;
+}
+
+size_t ReplayBuffer::GetBufferedBytes()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return buffered_bytes;
+}
+
+void ReplayBuffer::DumpAsync(const std::string &path, const std::string &format, DumpCallback callback)
+{
+    DumpJob job{path, format, {}, {}, std::move(callback)};
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        job.samples.assign(samples.begin(), samples.end());
+        job.parameter_sets = parameter_sets;
+    }
+    {
+        std::lock_guard<std::mutex> lock(dump_mutex);
+        dump_jobs.push_back(std::move(job));
+    }
+    dump_cond.notify_one();
+}
+
+void ReplayBuffer::RunDumps()
+{
+    std::unique_lock<std::mutex> lock(dump_mutex);
+    while (true)
+    {
+        dump_cond.wait(lock, [this]()
+                       { return stopping || !dump_jobs.empty(); });
+        if (dump_jobs.empty())
+            break;
+
+        DumpJob job = std::move(dump_jobs.front());
+        dump_jobs.pop_front();
+        lock.unlock();
+
+        std::string error;
+        try
+        {
+            Dump(job);
+        }
+        catch (const std::exception &e)
+        {
+            error = e.what();
+        }
+        if (job.callback)
+            job.callback(job.path, error);
+
+        lock.lock();
+    }
+}
+
+void ReplayBuffer::Dump(const DumpJob &job)
+{
+    if (job.samples.empty() || job.parameter_sets.empty())
+        throw std::runtime_error("Replay buffer is empty");
+
+    VideoMuxer muxer(job.path, job.format, codec, width, height);
+    muxer.Start(job.parameter_sets);
+
+    int64_t start_us = job.samples.front().time_us;
+    for (const auto &sample : job.samples)
+        muxer.Write(sample.data->data(), sample.data->size(), sample.time_us - start_us, sample.keyframe);
+    muxer.Finish();
+}
@@ -0,0 +1,98 @@
+#include "roi_detector.h"
+#include "frame_info.h"
+#include "luma_plane.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <stdexcept>
+
+RoiChangeDetector::RoiChangeDetector()
+    : next_id(1),
+      region_count(0)
+{ }
+
+int RoiChangeDetector::AddRegion(int x, int y, int width, int height, double threshold)
+{
+    if (x < 0 || y < 0 || width <= 0 || height <= 0)
+        throw std::invalid_argument("Region must have a positive size and start inside the frame");
+    if (threshold < 0.0)
+        throw std::invalid_argument("Threshold must not be negative");
+
+    std::lock_guard<std::mutex> lock(mutex);
+    int id = next_id++;
+    regions.push_back(Region{id, x, y, width, height, threshold, {}, {}});
+    region_count.store(static_cast<int>(regions.size()), std::memory_order_relaxed);
+    return id;
+}
+
+bool RoiChangeDetector::RemoveRegion(int id)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = std::find_if(regions.begin(), regions.end(), [id](const Region &region)
+                           { return region.id == id; });
+    if (it == regions.end())
+        return false;
+    regions.erase(it);
+    region_count.store(static_cast<int>(regions.size()), std::memory_order_relaxed);
+    return true;
+}
+
+void RoiChangeDetector::ClearRegions()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    regions.clear();
+    region_count.store(0, std::memory_order_relaxed);
+}
+
+void RoiChangeDetector::Process(const AVFrame *frame, std::vector<RegionChange> &changes)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    if (regions.empty())
+        return;
+
+    LumaPlane plane;
+    if (!plane.Init(frame))
+        return;
+
+    int64_t now = FrameClockNs();
+    for (auto &region : regions)
+    {
+        // Regions reaching past the frame are clipped, regions entirely outside of it never change
+        int width = std::min(region.width, frame->width - region.x);
+        int height = std::min(region.height, frame->height - region.y);
+        if (width <= 0 || height <= 0)
+            continue;
+
+        int step_x = std::max(1, width / MAX_SAMPLES_PER_AXIS);
+        int step_y = std::max(1, height / MAX_SAMPLES_PER_AXIS);
+
+        // Sized in place, so the buffer is only allocated again when the region grows
+        size_t columns = static_cast<size_t>((width + step_x - 1) / step_x);
+        size_t rows = static_cast<size_t>((height + step_y - 1) / step_y);
+        region.samples.resize(columns * rows);
+        uint8_t *sample = region.samples.data();
+        for (int y = region.y; y < region.y + height; y += step_y)
+        {
+            for (int x = region.x; x < region.x + width; x += step_x)
+                *sample++ = plane.At(x, y);
+        }
+
+        // A new region, or one whose frame changed size, starts from the current state
+        if (region.reference.size() != region.samples.size())
+        {
+            region.reference.swap(region.samples);
+            continue;
+        }
+
+        uint64_t sad = 0;
+        for (size_t i = 0; i < region.samples.size(); i++)
+            sad += static_cast<uint64_t>(std::abs(static_cast<int>(region.samples[i]) - static_cast<int>(region.reference[i])));
+
+        double difference = static_cast<double>(sad) / static_cast<double>(region.samples.size());
+        if (difference > region.threshold)
+        {
+            region.reference.swap(region.samples);
+            changes.push_back(RegionChange{region.id, difference, frame->pts, now});
+        }
+    }
+}
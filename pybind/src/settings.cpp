@@ -38,7 +38,9 @@ Settings::Settings() : rumbleHapticsIntensity(RumbleHapticsIntensity::Normal),
                        dpadTouchShortcut1(9),
                        dpadTouchShortcut2(10),
                        dpadTouchShortcut3(7),
-                       dpadTouchShortcut4(0)
+                       dpadTouchShortcut4(0),
+                       conversionThreads(1),
+                       conversionBackend(ConversionBackend::Swscale)
 // audioBufferSizeRaw(0),
 { }
 
@@ -0,0 +1,340 @@
+#include "shm_frame_ring.h"
+
+#include <chrono>
+#include <cstring>
+#include <stdexcept>
+#include <new>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cerrno>
+#endif
+
+extern "C"
+{
+#include <libavutil/imgutils.h>
+}
+
+// Keeps slot headers and frame data on their own cache lines
+#define SHM_ALIGN 64
+// Tries of ReadLatest() before it gives up on a slot the writer keeps busy
+#define SHM_READ_ATTEMPTS 64
+
+static size_t AlignUp(size_t value)
+{
+    return (value + SHM_ALIGN - 1) & ~(size_t)(SHM_ALIGN - 1);
+}
+
+// POSIX names need a leading slash, Windows names must not contain one
+static std::string MappingName(const std::string &name)
+{
+#ifdef _WIN32
+    return name[0] == '/' ? name.substr(1) : name;
+#else
+    return name[0] == '/' ? name : "/" + name;
+#endif
+}
+
+size_t ShmFrameRing::SlotDataOffset()
+{
+    return AlignUp(sizeof(SlotHeader));
+}
+
+ShmFrameRing::SlotHeader *ShmFrameRing::GetSlot(uint64_t index) const
+{
+    uint8_t *base = reinterpret_cast<uint8_t *>(header) + AlignUp(sizeof(Header));
+    return reinterpret_cast<SlotHeader *>(base + (index % header->slot_count) * header->slot_stride);
+}
+
+ShmFrameRing::ShmFrameRing(ShmFrameRing &&other) noexcept
+    : name(std::move(other.name)),
+      owner(other.owner),
+      header(other.header),
+      mapping_size(other.mapping_size)
+#ifdef _WIN32
+      ,
+      mapping(other.mapping)
+#endif
+{
+    other.owner = false;
+    other.header = nullptr;
+#ifdef _WIN32
+    other.mapping = nullptr;
+#endif
+}
+
+ShmFrameRing::~ShmFrameRing()
+{
+#ifdef _WIN32
+    if (header)
+        UnmapViewOfFile(header);
+    if (mapping)
+        CloseHandle(mapping);
+#else
+    if (header)
+        munmap(header, mapping_size);
+    if (owner)
+        shm_unlink(name.c_str());
+#endif
+}
+
+void ShmFrameRing::Map(size_t size, bool create)
+{
+#ifdef _WIN32
+    if (create)
+    {
+        mapping = CreateFileMappingA(INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE,
+                                     (DWORD)((uint64_t)size >> 32), (DWORD)(size & 0xffffffff), name.c_str());
+    }
+    else
+    {
+        mapping = OpenFileMappingA(FILE_MAP_READ | FILE_MAP_WRITE, FALSE, name.c_str());
+    }
+    if (!mapping)
+        throw std::runtime_error("Failed to open shared memory " + name);
+
+    header = static_cast<Header *>(MapViewOfFile(mapping, FILE_MAP_READ | FILE_MAP_WRITE, 0, 0, size));
+    if (!header)
+        throw std::runtime_error("Failed to map shared memory " + name);
+
+    if (!create)
+    {
+        MEMORY_BASIC_INFORMATION info;
+        VirtualQuery(header, &info, sizeof(info));
+        size = info.RegionSize;
+    }
+#else
+    int fd;
+    if (create)
+    {
+        // A ring left behind by a crashed writer is replaced, readers still mapping it keep the old one
+        shm_unlink(name.c_str());
+        fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+        if (fd >= 0 && ftruncate(fd, (off_t)size) < 0)
+        {
+            close(fd);
+            shm_unlink(name.c_str());
+            fd = -1;
+        }
+    }
+    else
+    {
+        fd = shm_open(name.c_str(), O_RDWR, 0);
+        struct stat st;
+        if (fd >= 0 && fstat(fd, &st) == 0)
+            size = (size_t)st.st_size;
+    }
+    if (fd < 0)
+        throw std::runtime_error("Failed to open shared memory " + name + ": " + strerror(errno));
+
+    void *address = size ? mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0) : MAP_FAILED;
+    close(fd);
+    if (address == MAP_FAILED)
+    {
+        if (create)
+            shm_unlink(name.c_str());
+        throw std::runtime_error("Failed to map shared memory " + name);
+    }
+    header = static_cast<Header *>(address);
+#endif
+    mapping_size = size;
+    owner = create;
+}
+
+ShmFrameRing ShmFrameRing::Create(const std::string &name, uint32_t slot_count, uint32_t width, uint32_t height, FrameFormat format)
+{
+    int frame_size = av_image_get_buffer_size(GetFramePixelFormat(format), (int)width, (int)height, 1);
+    if (slot_count == 0 || frame_size <= 0)
+        throw std::invalid_argument("Invalid shared memory ring geometry");
+
+    size_t slot_stride = AlignUp(SlotDataOffset() + (size_t)frame_size);
+
+    ShmFrameRing ring;
+    ring.name = MappingName(name);
+    ring.Map(AlignUp(sizeof(Header)) + slot_stride * slot_count, true);
+
+    Header *header = new (ring.header) Header();
+    header->version = VERSION;
+    header->slot_count = slot_count;
+    header->width = width;
+    header->height = height;
+    header->format = (int32_t)format;
+    header->frame_size = (uint64_t)frame_size;
+    header->slot_stride = slot_stride;
+    header->write_count.store(0);
+    for (uint32_t i = 0; i < slot_count; i++)
+        new (ring.GetSlot(i)) SlotHeader();
+
+    // Readers only accept the ring once the magic shows up, after everything else is in place
+    std::atomic_thread_fence(std::memory_order_release);
+    reinterpret_cast<std::atomic<uint32_t> *>(&header->magic)->store(MAGIC, std::memory_order_release);
+    return ring;
+}
+
+ShmFrameRing ShmFrameRing::Open(const std::string &name)
+{
+    ShmFrameRing ring;
+    ring.name = MappingName(name);
+    ring.Map(0, false);
+
+    if (ring.mapping_size < sizeof(Header) ||
+        reinterpret_cast<std::atomic<uint32_t> *>(&ring.header->magic)->load(std::memory_order_acquire) != MAGIC ||
+        ring.header->version != VERSION ||
+        ring.mapping_size < AlignUp(sizeof(Header)) + ring.header->slot_stride * ring.header->slot_count)
+    {
+        throw std::runtime_error("Shared memory " + name + " is not a frame ring");
+    }
+    return ring;
+}
+
+ShmFrameSink::ShmFrameSink(const std::string &name, uint32_t slot_count, uint32_t width, uint32_t height, FrameFormat format,
+                           FrameConverter &session_converter)
+    : ring(ShmFrameRing::Create(name, slot_count, width, height, format)),
+      converter(1),
+      push_frame(av_frame_alloc()),
+      running(true)
+{
+    if (!push_frame)
+        throw std::runtime_error("Failed to allocate AVFrame");
+    converter.ShareWorkers(session_converter);
+    converter.SetBackend(session_converter.GetBackend());
+    thread = std::thread([this]()
+                         { Run(); });
+}
+
+ShmFrameSink::~ShmFrameSink()
+{
+    running = false;
+    if (thread.joinable())
+        thread.join();
+    av_frame_free(&push_frame);
+}
+
+void ShmFrameSink::Push(const AVFrame *frame, int32_t frames_lost, uint64_t hash)
+{
+    if (av_frame_ref(push_frame, frame) < 0)
+        return;
+    pending.Publish(push_frame, frames_lost, hash);
+}
+
+void ShmFrameSink::Run()
+{
+    while (running)
+    {
+        // Wake up regularly to notice when the sink is stopped
+        if (!pending.WaitForFrame(std::chrono::steady_clock::now() + std::chrono::milliseconds(100)))
+            continue;
+
+        auto pending_lock = pending.Lock();
+        const LatestFrameSlot::Entry *entry = pending.Acquire();
+        if (entry)
+            Write(entry);
+    }
+}
+
+void ShmFrameSink::Write(const LatestFrameSlot::Entry *entry)
+{
+    ShmFrameRing::Header *header = ring.GetHeader();
+    auto converter_lock = converter.Lock();
+
+    FrameInfo info;
+    info.pts = entry->frame->pts;
+    info.sequence = entry->sequence;
+    info.frames_lost = entry->frames_lost;
+    info.decoded_ns = entry->decoded_ns;
+    info.hash = entry->hash;
+    info.convert_start_ns = FrameClockNs();
+
+    AVFrame *frame = converter.TransferHardwareFrame(entry->frame);
+    if (!frame)
+        return;
+
+    uint64_t frame_number = header->write_count.load(std::memory_order_relaxed) + 1;
+    ShmFrameRing::SlotHeader *slot = ring.GetSlot(frame_number - 1);
+
+    uint64_t lock = slot->lock.load(std::memory_order_relaxed);
+    slot->lock.store(lock + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    bool converted = converter.ConvertToBuffer(frame, GetFramePixelFormat((FrameFormat)header->format), (int)header->width, (int)header->height,
+                                               ring.GetSlotData(frame_number - 1), header->frame_size);
+    info.convert_end_ns = FrameClockNs();
+    slot->frame_number = converted ? frame_number : 0;
+    slot->info = info;
+
+    slot->lock.store(lock + 2, std::memory_order_release);
+    if (converted)
+        header->write_count.store(frame_number, std::memory_order_release);
+}
+
+ShmFrameReader::ShmFrameReader(const std::string &name)
+    : ring(ShmFrameRing::Open(name)),
+      last_read(0)
+{ }
+
+FrameResult ShmFrameReader::ReadLatest(uint8_t *target, size_t target_size, FrameInfo *info)
+{
+    ShmFrameRing::Header *header = ring.GetHeader();
+    if (target_size < header->frame_size)
+        return FrameResult::TargetTooSmall;
+
+    // The writer holds a slot for a whole conversion, so retries back off instead of spinning a core
+    for (int attempt = 0; attempt < SHM_READ_ATTEMPTS; attempt++)
+    {
+        if (attempt >= SHM_READ_ATTEMPTS / 2)
+            std::this_thread::sleep_for(std::chrono::microseconds(100));
+        else if (attempt > 0)
+            std::this_thread::yield();
+
+        uint64_t frame_number = header->write_count.load(std::memory_order_acquire);
+        if (frame_number == 0 || frame_number == last_read)
+            return FrameResult::NoFrame;
+
+        ShmFrameRing::SlotHeader *slot = ring.GetSlot(frame_number - 1);
+        uint64_t lock = slot->lock.load(std::memory_order_acquire);
+        if (lock & 1)
+            continue;
+
+        memcpy(target, ring.GetSlotData(frame_number - 1), header->frame_size);
+        uint64_t slot_frame_number = slot->frame_number;
+        FrameInfo slot_info = slot->info;
+
+        std::atomic_thread_fence(std::memory_order_acquire);
+        // The writer went around the ring while we were copying, try again with the newer frame
+        if (slot->lock.load(std::memory_order_relaxed) != lock)
+            continue;
+        if (slot_frame_number != frame_number)
+        {
+            // A failed conversion overwrote the slot without publishing a newer frame, nothing to read until the next one
+            if (header->write_count.load(std::memory_order_acquire) == frame_number)
+                return FrameResult::NoFrame;
+            continue;
+        }
+
+        last_read = frame_number;
+        if (info)
+            *info = slot_info;
+        return FrameResult::Success;
+    }
+    return FrameResult::NoFrame;
+}
+
+bool ShmFrameReader::WaitForFrame(int timeout_ms) const
+{
+    // Other processes cannot signal us cheaply, so poll at a rate well above any stream's frame rate
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms);
+    while (true)
+    {
+        uint64_t frame_number = GetWriteCount();
+        if (frame_number != 0 && frame_number != last_read)
+            return true;
+        if (std::chrono::steady_clock::now() >= deadline)
+            return false;
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+}
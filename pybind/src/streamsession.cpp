@@ -3,6 +3,7 @@
 #include "streamsession.h"
 #include "settings.h"
 #include "controllermanager.h"
+#include "nal_parser.h"
 
 #include <ios>
 #include <cstring>
@@ -18,6 +19,11 @@
 #include <chiaki/session.h>
 // #include <chiaki/chiaki_time.h>
 
+extern "C"
+{
+#include <libavutil/hwcontext.h>
+}
+
 #ifdef _WIN32
 #define WIN32_LEAN_AND_MEAN
 #include <winsock2.h>
@@ -147,6 +153,8 @@ StreamSessionConnectInfo::StreamSessionConnectInfo(
     this->dpad_touch_shortcut4 = settings->GetDpadTouchShortcut4();
     if (this->dpad_touch_shortcut4 > 0)
         this->dpad_touch_shortcut4 = 1 << (this->dpad_touch_shortcut4 - 1);
+    this->conversion_threads = settings->GetConversionThreads();
+    this->conversion_backend = settings->GetConversionBackend();
 }
 
 static void AudioSettingsCb(uint32_t channels, uint32_t rate, void *user);
@@ -154,6 +162,7 @@ static void AudioFrameCb(int16_t *buf, size_t samples_count, void *user);
 static void HapticsFrameCb(uint8_t *buf, size_t buf_size, void *user);
 static void CantDisplayCb(void *user, bool cant_display);
 static void EventCb(ChiakiEvent *event, void *user);
+static bool VideoSampleCb(uint8_t *buf, size_t buf_size, int32_t frames_lost, bool frame_recovered, void *user);
 static void FfmpegFrameCb(ChiakiFfmpegDecoder *decoder, void *user);
 
 StreamSession::StreamSession(const StreamSessionConnectInfo &connect_info)
@@ -185,11 +194,15 @@ StreamSession::StreamSession(const StreamSessionConnectInfo &connect_info)
     memset(led_color, 0, sizeof(led_color));
     ChiakiErrorCode err;
     ffmpeg_decoder = new ChiakiFfmpegDecoder;
+    sw_frame = av_frame_alloc();
+    if (!sw_frame)
+        throw ChiakiException("Failed to allocate AVFrame");
     ChiakiLogSniffer sniffer;
     chiaki_log_sniffer_init(&sniffer, CHIAKI_LOG_ALL, GetChiakiLog());
+    video_codec = chiaki_target_is_ps5(connect_info.target) ? connect_info.video_profile.codec : CHIAKI_CODEC_H264;
     err = chiaki_ffmpeg_decoder_init(ffmpeg_decoder,
                                         chiaki_log_sniffer_get_log(&sniffer),
-                                        chiaki_target_is_ps5(connect_info.target) ? connect_info.video_profile.codec : CHIAKI_CODEC_H264,
+                                        video_codec,
                                         connect_info.hw_decoder.empty() ? NULL : connect_info.hw_decoder.c_str(),
                                         connect_info.hw_device_ctx, FfmpegFrameCb, this);
     if (err != CHIAKI_ERR_SUCCESS)
@@ -200,6 +213,7 @@ StreamSession::StreamSession(const StreamSessionConnectInfo &connect_info)
     }
     chiaki_log_sniffer_fini(&sniffer);
     ffmpeg_decoder->log = GetChiakiLog();
+    keyframe_filter = std::make_unique<KeyframeFilter>(GetChiakiLog(), video_codec);
     audio_volume = connect_info.audio_volume;
     start_mic_unmuted = connect_info.start_mic_unmuted;
     audio_out_device_name = connect_info.audio_out_device;
@@ -208,6 +222,8 @@ StreamSession::StreamSession(const StreamSessionConnectInfo &connect_info)
     chiaki_opus_decoder_init(&opus_decoder, log.GetChiakiLog());
     chiaki_opus_encoder_init(&opus_encoder, log.GetChiakiLog());
     audio_buffer_size = connect_info.audio_buffer_size;
+    frame_converter.SetThreadCount(connect_info.conversion_threads);
+    frame_converter.SetBackend(connect_info.conversion_backend);
 
     host = connect_info.host;
 
@@ -309,18 +325,37 @@ StreamSession::StreamSession(const StreamSessionConnectInfo &connect_info)
         haptics_sink.frame_cb = HapticsFrameCb;
         chiaki_session_set_haptics_sink(&session, &haptics_sink);
     }
-    chiaki_session_set_video_sample_cb(&session, chiaki_ffmpeg_decoder_video_sample_cb, ffmpeg_decoder);
+    chiaki_session_set_video_sample_cb(&session, VideoSampleCb, this);
 
     chiaki_session_set_event_cb(&session, EventCb, this);
+
+    FfmpegFrameAvailable.set_dispatcher(&event_dispatcher);
+    SessionQuit.set_dispatcher(&event_dispatcher);
+    LoginPINRequested.set_dispatcher(&event_dispatcher);
+    DataHolepunchProgress.set_dispatcher(&event_dispatcher);
+    AutoRegistSucceeded.set_dispatcher(&event_dispatcher);
+    NicknameReceived.set_dispatcher(&event_dispatcher);
+    ConnectedChanged.set_dispatcher(&event_dispatcher);
+    MeasuredBitrateChanged.set_dispatcher(&event_dispatcher);
+    AveragePacketLossChanged.set_dispatcher(&event_dispatcher);
+    CantDisplayChanged.set_dispatcher(&event_dispatcher);
+    RegionChanged.set_dispatcher(&event_dispatcher);
+    ReplayDumped.set_dispatcher(&event_dispatcher);
+    // Only the latest frame can be pulled anyway, quitting and PIN prompts must not get lost
+    FfmpegFrameAvailable.set_policy(BackpressurePolicy::CoalesceLatest, 1, 0.0);
+    SessionQuit.set_policy(BackpressurePolicy::Block, 16, 0.0);
+    LoginPINRequested.set_policy(BackpressurePolicy::Block, 16, 0.0);
+    AutoRegistSucceeded.set_policy(BackpressurePolicy::Block, 16, 0.0);
+    // The bitrate changes with nearly every frame
+    MeasuredBitrateChanged.set_throttle(10.0, 0.0);
     key_map = connect_info.key_map;
     if (connect_info.enable_dualsense)
     {
         rumble_haptics_intensity = connect_info.rumble_haptics_intensity;
     }
 
-    Timer *packet_loss_timer = new Timer();
-    packet_loss_timer->setInterval(200);
-    packet_loss_timer->start([this]() {
+    packet_loss_timer.setInterval(200);
+    packet_loss_timer.start([this]() {
         if (packet_loss_history.size() > 10)
             packet_loss_history.erase(packet_loss_history.begin());
 
@@ -342,12 +377,30 @@ StreamSession::StreamSession(const StreamSessionConnectInfo &connect_info)
 
 StreamSession::~StreamSession()
 {
+    StopShmSink();
+    {
+        std::lock_guard<std::mutex> lock(recorder_mutex);
+        if (recorder)
+            RemoveVideoSampleSink(recorder);
+        recorder.reset();
+    }
+    // Finished dumps emit events, so the GIL must not be held while they are waited for
+    if (PyGILState_Check())
+    {
+        py::gil_scoped_release release;
+        ResetReplayBuffer();
+    }
+    else
+        ResetReplayBuffer();
     /*if (audio_out)
         SDL_CloseAudioDevice(audio_out);
     if (audio_in)
         SDL_CloseAudioDevice(audio_in);*/
+    packet_loss_timer.stop();
     if (session_started)
         chiaki_session_join(&session);
+    // Every thread emitting events is gone now, so whatever is still queued can be delivered
+    event_dispatcher.Stop();
     chiaki_session_fini(&session);
     chiaki_opus_decoder_fini(&opus_decoder);
     chiaki_opus_encoder_fini(&opus_encoder);
@@ -356,6 +409,7 @@ StreamSession::~StreamSession()
         chiaki_ffmpeg_decoder_fini(ffmpeg_decoder);
         delete ffmpeg_decoder;
     }
+    av_frame_free(&sw_frame);
     /*if (dpad_touch_stop_timer)
     {
         delete dpad_touch_stop_timer;
@@ -558,7 +612,50 @@ void StreamSession::CancelPsnConnection(bool stop_thread)
 
 void StreamSession::TriggerFfmpegFrameAvailable()
 {
-    FfmpegFrameAvailable.next(true);
+    // Frames are pulled here on the decoder thread, so readers only ever see the latest one
+    int32_t frames_lost;
+    AVFrame *frame = chiaki_ffmpeg_decoder_pull_frame(ffmpeg_decoder, &frames_lost);
+    // Hashing system memory frames costs next to nothing, hardware frames are only transferred when the hash is needed
+    uint64_t hash = 0;
+    bool hashed = frame && (!frame->hw_frames_ctx || frame_decimator.GetSuppressDuplicates()) &&
+                  frame_hasher.Compute(SoftwareFrame(frame), &hash);
+    // Regions are checked on every decoded frame, a change too small to flip the frame hash is still caught.
+    // Only the Y plane is sampled, which is far cheaper than handing full frames to Python
+    if (frame && roi_detector.HasRegions())
+    {
+        region_changes.clear();
+        roi_detector.Process(SoftwareFrame(frame), region_changes);
+        for (const auto &change : region_changes)
+            RegionChanged.next(change);
+    }
+    if (frame && !frame_decimator.Select(FrameClockNs(), hashed ? &hash : nullptr))
+    {
+        // Still pulled to keep the decoder going, the losses are reported with the next delivered frame
+        decimated_frames_lost += frames_lost;
+        av_frame_free(&frame);
+    }
+    else if (frame)
+    {
+        frames_lost += decimated_frames_lost;
+        decimated_frames_lost = 0;
+
+        // A download made for the checks above is handed on, so readers do not transfer the frame once more
+        AVFrame *delivered = sw_frame->buf[0] ? sw_frame : frame;
+        {
+            std::lock_guard<std::mutex> lock(shm_sink_mutex);
+            if (shm_sink)
+                shm_sink->Push(delivered, frames_lost, hash);
+        }
+
+        latest_frame.Publish(delivered, frames_lost, hash);
+        av_frame_free(&frame);
+
+        // Acquiring the GIL for every frame is only worth it if someone listens
+        if (FfmpegFrameAvailable.has_subscribers())
+            FfmpegFrameAvailable.next(true);
+    }
+    av_frame_unref(sw_frame);
+
     if (measured_bitrate != session.stream_connection.measured_bitrate)
     {
         measured_bitrate = session.stream_connection.measured_bitrate;
@@ -566,6 +663,275 @@ void StreamSession::TriggerFfmpegFrameAvailable()
     }
 }
 
+AVFrame *StreamSession::SoftwareFrame(AVFrame *frame)
+{
+    if (!frame->hw_frames_ctx)
+        return frame;
+    if (!sw_frame->buf[0])
+    {
+        // Fresh buffers every time, the download is published along with the frame
+        if (av_hwframe_transfer_data(sw_frame, frame, 0) < 0)
+        {
+            av_frame_unref(sw_frame);
+            return frame;
+        }
+        av_frame_copy_props(sw_frame, frame);
+    }
+    return sw_frame;
+}
+
+void StreamSession::StartShmSink(const std::string &name, FrameFormat format, uint32_t width, uint32_t height, uint32_t slot_count)
+{
+    if (!width || !height)
+    {
+        width = session.connect_info.video_profile.width;
+        height = session.connect_info.video_profile.height;
+    }
+
+    // The old sink is stopped first, it might own a ring with the same name
+    StopShmSink();
+    auto sink = std::make_unique<ShmFrameSink>(name, slot_count, width, height, format, frame_converter);
+    std::lock_guard<std::mutex> lock(shm_sink_mutex);
+    shm_sink = std::move(sink);
+}
+
+void StreamSession::StopShmSink()
+{
+    std::unique_ptr<ShmFrameSink> sink;
+    {
+        std::lock_guard<std::mutex> lock(shm_sink_mutex);
+        sink = std::move(shm_sink);
+    }
+    // Joined outside of the lock, so the decoder thread is never held up by it
+}
+
+bool StreamSession::PushVideoSample(uint8_t *buf, size_t buf_size, int32_t frames_lost, bool frame_recovered)
+{
+    bool result = true;
+    int64_t now_us = FrameClockNs() / 1000;
+    if (keyframe_filter->Select(buf, buf_size, now_us))
+    {
+        result = chiaki_ffmpeg_decoder_video_sample_cb(buf, buf_size, frames_lost + filtered_frames_lost, frame_recovered, ffmpeg_decoder);
+        filtered_frames_lost = 0;
+    }
+    else
+        filtered_frames_lost += frames_lost;
+    bool request_keyframe = keyframe_requested.exchange(false, std::memory_order_relaxed);
+    if (keyframe_filter->TakeKeyframeRequest(now_us) || request_keyframe)
+        SendKeyframeRequest();
+
+    RawVideoSampleReceived.next({buf, buf_size, frames_lost, frame_recovered});
+
+    uint64_t index = video_sample_index++;
+    // Native code receives samples through VideoSampleSink, this is only built for Python
+    if (VideoSampleReceived.has_python_subscribers())
+    {
+        // buf is reused by the receiver, so it is copied once, before taking the GIL, into a block views can keep alive
+        bool hevc = chiaki_codec_is_h265(video_codec);
+        bool keyframe = ParseVideoSample(buf, buf_size, hevc, nullptr);
+        VideoSamplePool::Block block = video_sample_pool->Copy(buf, buf_size);
+        py::gil_scoped_acquire gil;
+        auto sample = std::make_shared<PyVideoSample>(std::move(block), index, keyframe, hevc, frames_lost, frame_recovered);
+        // Called from chiaki's receive thread, nothing may unwind into its C frames
+        try
+        {
+            VideoSampleReceived.next(sample);
+        }
+        catch (py::error_already_set &error)
+        {
+            error.discard_as_unraisable("on_video_sample");
+        }
+        catch (const std::exception &error)
+        {
+            CHIAKI_LOGE(GetChiakiLog(), "Exception in video sample callback: %s", error.what());
+        }
+        catch (...)
+        {
+            CHIAKI_LOGE(GetChiakiLog(), "Unknown exception in video sample callback");
+        }
+        sample->invalidate();
+    }
+    return result;
+}
+
+void StreamSession::SendKeyframeRequest()
+{
+    // The console answers a corrupt frame report with a keyframe, the same way the video receiver recovers from loss
+    ChiakiVideoReceiver *receiver = session.stream_connection.video_receiver;
+    if (!receiver)
+        return;
+    ChiakiSeqNum16 frame = static_cast<ChiakiSeqNum16>(receiver->frame_index_cur);
+    ChiakiErrorCode err = chiaki_stream_connection_send_corrupt_frame(&session.stream_connection, frame, frame);
+    if (err != CHIAKI_ERR_SUCCESS)
+        CHIAKI_LOGE(GetChiakiLog(), "Failed to request a keyframe: %s", chiaki_error_string(err));
+}
+
+template <typename T>
+static uint64_t LostEventCount(const EventSource<T> &source)
+{
+    return source.get_dropped_count() + source.get_coalesced_count();
+}
+
+uint64_t StreamSession::GetDroppedEventCount() const
+{
+    return event_dispatcher.GetDroppedCount() + LostEventCount(FfmpegFrameAvailable) + LostEventCount(SessionQuit) +
+           LostEventCount(LoginPINRequested) + LostEventCount(DataHolepunchProgress) + LostEventCount(AutoRegistSucceeded) +
+           LostEventCount(NicknameReceived) + LostEventCount(ConnectedChanged) + LostEventCount(MeasuredBitrateChanged) +
+           LostEventCount(AveragePacketLossChanged) + LostEventCount(CantDisplayChanged) + LostEventCount(RegionChanged) +
+           LostEventCount(ReplayDumped);
+}
+
+#ifdef CHIAKI_PY_TEST_HOOKS
+void StreamSession::EmitTestEvents(uint32_t frame_count, uint32_t thread_count, bool quit)
+{
+    std::vector<std::thread> threads;
+    for (uint32_t i = 0; i < std::max<uint32_t>(1, thread_count); i++)
+    {
+        threads.emplace_back([this, frame_count]()
+                             {
+            for (uint32_t frame = 0; frame < frame_count; frame++)
+                FfmpegFrameAvailable.next(true); });
+    }
+    for (auto &thread : threads)
+        thread.join();
+    if (quit)
+        SessionQuit.next(CHIAKI_QUIT_REASON_STOPPED);
+}
+#endif
+
+void StreamSession::AddVideoSampleSink(const std::shared_ptr<VideoSampleSink> &sink)
+{
+    // The sink outlives its subscription, RemoveVideoSampleSink() only returns once it is not called anymore
+    VideoSampleSink *target = sink.get();
+    auto subscription = RawVideoSampleReceived.subscribe_native([target](const VideoSampleData &sample)
+                                                                { target->PushVideoSample(sample.buf, sample.buf_size, sample.frames_lost, sample.frame_recovered); });
+    std::lock_guard<std::mutex> lock(video_sample_sinks_mutex);
+    video_sample_sinks.emplace_back(sink, std::move(subscription));
+}
+
+void StreamSession::RemoveVideoSampleSink(const std::shared_ptr<VideoSampleSink> &sink)
+{
+    std::vector<std::shared_ptr<EventSource<VideoSampleData>::Subscription>> removed;
+    {
+        std::lock_guard<std::mutex> lock(video_sample_sinks_mutex);
+        for (auto it = video_sample_sinks.begin(); it != video_sample_sinks.end();)
+        {
+            if (it->first != sink)
+            {
+                ++it;
+                continue;
+            }
+            removed.push_back(std::move(it->second));
+            it = video_sample_sinks.erase(it);
+        }
+    }
+    // Waits for a push in flight on the receive thread
+    for (auto &subscription : removed)
+        subscription->unsubscribe();
+}
+
+void StreamSession::StartRecording(const std::string &path, const std::string &format)
+{
+    std::lock_guard<std::mutex> lock(recorder_mutex);
+    auto new_recorder = std::make_shared<VideoRecorder>(path, format, video_codec,
+                                                        session.connect_info.video_profile.width,
+                                                        session.connect_info.video_profile.height,
+                                                        [this]()
+                                                        { RequestKeyframe(); });
+    if (recorder)
+        RemoveVideoSampleSink(recorder);
+    AddVideoSampleSink(new_recorder);
+    // The console only sends keyframes at the start and after a loss, the recording starts at the next one
+    RequestKeyframe();
+    // The previous recording is finished here, its errors are dropped along with it
+    recorder = std::move(new_recorder);
+}
+
+void StreamSession::StopRecording()
+{
+    std::shared_ptr<VideoRecorder> stopped;
+    {
+        std::lock_guard<std::mutex> lock(recorder_mutex);
+        if (!recorder)
+            return;
+        RemoveVideoSampleSink(recorder);
+        stopped = std::move(recorder);
+    }
+    // Finished outside of the lock, writing the trailer may take a while
+    std::string error = stopped->Stop();
+    if (!error.empty())
+        throw std::runtime_error("Recording failed: " + error);
+}
+
+bool StreamSession::IsRecording()
+{
+    std::lock_guard<std::mutex> lock(recorder_mutex);
+    return recorder != nullptr;
+}
+
+void StreamSession::EnableReplay(double seconds, size_t max_bytes)
+{
+    if (seconds <= 0.0 && max_bytes == 0)
+        throw std::invalid_argument("Replay needs a duration or size limit");
+
+    auto buffer = std::make_shared<ReplayBuffer>(video_codec,
+                                                 session.connect_info.video_profile.width,
+                                                 session.connect_info.video_profile.height,
+                                                 static_cast<int64_t>(seconds * 1e6), max_bytes,
+                                                 [this]()
+                                                 { RequestKeyframe(); });
+    std::shared_ptr<ReplayBuffer> replaced;
+    {
+        // Swapped in one go, so concurrent calls cannot leave a buffer behind in the sinks
+        std::lock_guard<std::mutex> lock(replay_buffer_mutex);
+        if (replay_buffer)
+            RemoveVideoSampleSink(replay_buffer);
+        AddVideoSampleSink(buffer);
+        replaced = std::move(replay_buffer);
+        replay_buffer = std::move(buffer);
+    }
+    // Buffering starts at a keyframe, which the console would otherwise only send after a loss
+    RequestKeyframe();
+    // Waits for pending dumps of the old buffer outside of the lock
+}
+
+void StreamSession::DisableReplay()
+{
+    ResetReplayBuffer();
+}
+
+void StreamSession::ResetReplayBuffer()
+{
+    std::shared_ptr<ReplayBuffer> buffer;
+    {
+        std::lock_guard<std::mutex> lock(replay_buffer_mutex);
+        if (!replay_buffer)
+            return;
+        RemoveVideoSampleSink(replay_buffer);
+        buffer = std::move(replay_buffer);
+    }
+    // Waits for pending dumps outside of the lock
+}
+
+void StreamSession::DumpReplay(const std::string &path, const std::string &format)
+{
+    std::lock_guard<std::mutex> lock(replay_buffer_mutex);
+    if (!replay_buffer)
+        throw std::runtime_error("Replay is not enabled");
+    replay_buffer->DumpAsync(path, format, [this](const std::string &path, const std::string &error)
+                             {
+        if (error.empty())
+            ReplayDumped.next(path);
+        else
+            ReplayDumped.error(-1, error); });
+}
+
+double StreamSession::GetReplaySeconds()
+{
+    std::lock_guard<std::mutex> lock(replay_buffer_mutex);
+    return replay_buffer ? replay_buffer->GetBufferedSeconds() : 0.0;
+}
+
 class StreamSessionPrivate
 {
 public:
@@ -584,6 +950,7 @@ public:
     static void CantDisplayMessage(StreamSession *session, bool cant_display) { session->CantDisplayMessage(cant_display); }
     static void Event(StreamSession *session, ChiakiEvent *event) { session->Event(event); }
     static void TriggerFfmpegFrameAvailable(StreamSession *session) { session->TriggerFfmpegFrameAvailable(); }
+    static bool PushVideoSample(StreamSession *session, uint8_t *buf, size_t buf_size, int32_t frames_lost, bool frame_recovered) { return session->PushVideoSample(buf, buf_size, frames_lost, frame_recovered); }
 };
 
 static void AudioSettingsCb(uint32_t channels, uint32_t rate, void *user)
@@ -616,6 +983,12 @@ static void EventCb(ChiakiEvent *event, void *user)
     StreamSessionPrivate::Event(session, event);
 }
 
+static bool VideoSampleCb(uint8_t *buf, size_t buf_size, int32_t frames_lost, bool frame_recovered, void *user)
+{
+    auto session = reinterpret_cast<StreamSession *>(user);
+    return StreamSessionPrivate::PushVideoSample(session, buf, buf_size, frames_lost, frame_recovered);
+}
+
 static void FfmpegFrameCb(ChiakiFfmpegDecoder *decoder, void *user)
 {
     auto session = reinterpret_cast<StreamSession *>(user);
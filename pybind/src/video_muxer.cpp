@@ -0,0 +1,126 @@
+#include "video_muxer.h"
+
+#include <cstring>
+#include <stdexcept>
+
+extern "C"
+{
+#include <libavutil/mem.h>
+}
+
+static std::string AvErrorString(int err)
+{
+    char message[AV_ERROR_MAX_STRING_SIZE] = {};
+    av_strerror(err, message, sizeof(message));
+    return message;
+}
+
+VideoMuxer::VideoMuxer(const std::string &path, const std::string &format, ChiakiCodec codec, int width, int height)
+    : path(path),
+      context(nullptr),
+      stream(nullptr),
+      packet(nullptr),
+      started(false),
+      last_dts(AV_NOPTS_VALUE)
+{
+    int err = avformat_alloc_output_context2(&context, nullptr, format.empty() ? nullptr : format.c_str(), path.c_str());
+    if (err < 0 || !context)
+        throw std::runtime_error("Failed to create output for " + path + ": " + AvErrorString(err));
+
+    stream = avformat_new_stream(context, nullptr);
+    packet = av_packet_alloc();
+    if (!stream || !packet)
+    {
+        av_packet_free(&packet);
+        avformat_free_context(context);
+        throw std::runtime_error("Failed to allocate output stream");
+    }
+    stream->codecpar->codec_type = AVMEDIA_TYPE_VIDEO;
+    stream->codecpar->codec_id = chiaki_codec_is_h265(codec) ? AV_CODEC_ID_HEVC : AV_CODEC_ID_H264;
+    stream->codecpar->width = width;
+    stream->codecpar->height = height;
+    stream->time_base = AVRational{1, 1000000};
+
+    if (!(context->oformat->flags & AVFMT_NOFILE))
+    {
+        err = avio_open(&context->pb, path.c_str(), AVIO_FLAG_WRITE);
+        if (err < 0)
+        {
+            av_packet_free(&packet);
+            avformat_free_context(context);
+            throw std::runtime_error("Failed to open " + path + ": " + AvErrorString(err));
+        }
+    }
+}
+
+VideoMuxer::~VideoMuxer()
+{
+    try
+    {
+        Finish();
+    }
+    catch (const std::exception &)
+    {
+        // Nothing left to report to in a destructor
+    }
+}
+
+void VideoMuxer::Start(const std::vector<uint8_t> &parameter_sets)
+{
+    if (started || !context)
+        return;
+
+    // Muxers that need avcC/hvcC convert Annex B extradata themselves
+    stream->codecpar->extradata = static_cast<uint8_t *>(av_mallocz(parameter_sets.size() + AV_INPUT_BUFFER_PADDING_SIZE));
+    if (!stream->codecpar->extradata)
+        throw std::runtime_error("Failed to allocate extradata");
+    memcpy(stream->codecpar->extradata, parameter_sets.data(), parameter_sets.size());
+    stream->codecpar->extradata_size = static_cast<int>(parameter_sets.size());
+
+    int err = avformat_write_header(context, nullptr);
+    if (err < 0)
+        throw std::runtime_error("Failed to write header of " + path + ": " + AvErrorString(err));
+    started = true;
+}
+
+void VideoMuxer::Write(const uint8_t *buf, size_t size, int64_t time_us, bool keyframe)
+{
+    if (!started)
+        return;
+
+    int err = av_new_packet(packet, static_cast<int>(size));
+    if (err < 0)
+        throw std::runtime_error("Failed to allocate packet: " + AvErrorString(err));
+    memcpy(packet->data, buf, size);
+
+    // The stream has no B-frames, so decode and presentation order are the same
+    int64_t dts = av_rescale_q(time_us, AVRational{1, 1000000}, stream->time_base);
+    if (last_dts != AV_NOPTS_VALUE && dts <= last_dts)
+        dts = last_dts + 1;
+    last_dts = dts;
+    packet->pts = packet->dts = dts;
+    packet->stream_index = stream->index;
+    if (keyframe)
+        packet->flags |= AV_PKT_FLAG_KEY;
+
+    err = av_write_frame(context, packet);
+    av_packet_unref(packet);
+    if (err < 0)
+        throw std::runtime_error("Failed to write to " + path + ": " + AvErrorString(err));
+}
+
+void VideoMuxer::Finish()
+{
+    if (!context)
+        return;
+
+    int err = started ? av_write_trailer(context) : 0;
+    if (!(context->oformat->flags & AVFMT_NOFILE))
+        avio_closep(&context->pb);
+    avformat_free_context(context);
+    context = nullptr;
+    stream = nullptr;
+    av_packet_free(&packet);
+    if (err < 0)
+        throw std::runtime_error("Failed to finish " + path + ": " + AvErrorString(err));
+}
@@ -0,0 +1,144 @@
+#include "video_recorder.h"
+#include "nal_parser.h"
+#include "frame_info.h"
+
+VideoRecorder::VideoRecorder(const std::string &path, const std::string &format, ChiakiCodec codec, int width, int height,
+                             std::function<void()> request_keyframe)
+    : muxer(path, format, codec, width, height),
+      hevc(chiaki_codec_is_h265(codec)),
+      request_keyframe(std::move(request_keyframe)),
+      start_us(0),
+      stopping(false),
+      gap(false),
+      written(0),
+      dropped(0)
+{
+    thread = std::thread([this]()
+                         { Run(); });
+}
+
+VideoRecorder::~VideoRecorder()
+{
+    Stop();
+}
+
+std::string VideoRecorder::Stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    cond.notify_one();
+    if (thread.joinable())
+        thread.join();
+    return GetError();
+}
+
+void VideoRecorder::PushVideoSample(const uint8_t *buf, size_t buf_size, int32_t frames_lost, bool frame_recovered)
+{
+    int64_t time_us = FrameClockNs() / 1000;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (stopping || !error.empty())
+            return;
+        // Samples after lost frames may reference pictures the file does not have
+        if (frames_lost > 0)
+            gap = true;
+        if (queue.size() >= MAX_QUEUED_SAMPLES)
+        {
+            dropped++;
+            gap = true;
+            return;
+        }
+        queue.push_back(Sample{std::vector<uint8_t>(buf, buf + buf_size), time_us, gap});
+        gap = false;
+    }
+    cond.notify_one();
+}
+
+std::string VideoRecorder::GetError() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return error;
+}
+
+void VideoRecorder::Run()
+{
+    bool waiting_for_keyframe = true;
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true)
+    {
+        cond.wait(lock, [this]()
+                  { return stopping || !queue.empty(); });
+        if (queue.empty())
+            break;
+
+        Sample sample = std::move(queue.front());
+        queue.pop_front();
+
+        // Muxing may block on disk I/O, which must not hold up the receive thread
+        lock.unlock();
+        std::string write_error;
+        try
+        {
+            Write(sample, waiting_for_keyframe);
+        }
+        catch (const std::exception &e)
+        {
+            write_error = e.what();
+        }
+        lock.lock();
+
+        if (!write_error.empty())
+        {
+            error = write_error;
+            queue.clear();
+            break;
+        }
+    }
+    lock.unlock();
+
+    try
+    {
+        muxer.Finish();
+    }
+    catch (const std::exception &e)
+    {
+        lock.lock();
+        if (error.empty())
+            error = e.what();
+    }
+}
+
+void VideoRecorder::Write(const Sample &sample, bool &waiting_for_keyframe)
+{
+    if (sample.after_gap && !waiting_for_keyframe)
+    {
+        waiting_for_keyframe = true;
+        if (request_keyframe)
+            request_keyframe();
+    }
+
+    std::vector<uint8_t> parameter_sets;
+    bool keyframe = ParseVideoSample(sample.data.data(), sample.data.size(), hevc, muxer.IsStarted() ? nullptr : &parameter_sets);
+    if (waiting_for_keyframe && !keyframe)
+    {
+        dropped++;
+        return;
+    }
+
+    if (!muxer.IsStarted())
+    {
+        if (parameter_sets.empty())
+        {
+            dropped++;
+            return;
+        }
+        muxer.Start(parameter_sets);
+        start_us = sample.time_us;
+    }
+    waiting_for_keyframe = false;
+
+    muxer.Write(sample.data.data(), sample.data.size(), sample.time_us - start_us, keyframe);
+    written++;
+}
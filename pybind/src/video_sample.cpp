@@ -0,0 +1,176 @@
+#include "video_sample.h"
+#include "nal_parser.h"
+
+#define SAMPLE_EXPIRED_MESSAGE "Video sample is only valid during the callback, use copy() to keep it"
+
+VideoSamplePool::Block VideoSamplePool::Copy(const uint8_t *data, size_t size)
+{
+    std::unique_ptr<std::vector<uint8_t>> block;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!free_blocks.empty())
+        {
+            block = std::move(free_blocks.back());
+            free_blocks.pop_back();
+        }
+    }
+    if (!block)
+        block = std::make_unique<std::vector<uint8_t>>();
+    // Keeps the capacity of a recycled block, so steady streams stop allocating
+    block->assign(data, data + size);
+
+    std::weak_ptr<VideoSamplePool> pool = shared_from_this();
+    return Block(block.release(), [pool](const std::vector<uint8_t> *released)
+                 {
+        std::unique_ptr<std::vector<uint8_t>> owned(const_cast<std::vector<uint8_t> *>(released));
+        if (auto alive = pool.lock())
+            alive->Recycle(std::move(owned)); });
+}
+
+void VideoSamplePool::Recycle(std::unique_ptr<std::vector<uint8_t>> block)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    if (free_blocks.size() < MAX_FREE_BLOCKS)
+        free_blocks.push_back(std::move(block));
+}
+
+namespace
+{
+struct SampleBufferState
+{
+    VideoSamplePool::Block block;
+    /** Views currently exported, counted by getbuffer and releasebuffer */
+    Py_ssize_t exports = 0;
+    bool closed = false;
+};
+
+// Buffer protocol exporter of a sample block, all of its views are backed by the block it holds
+struct SampleBufferObject
+{
+    PyObject_HEAD
+    SampleBufferState *state;
+};
+
+int SampleBufferGetBuffer(PyObject *self, Py_buffer *view, int flags)
+{
+    SampleBufferState *state = reinterpret_cast<SampleBufferObject *>(self)->state;
+    if (!state || state->closed || !state->block)
+    {
+        view->obj = nullptr;
+        PyErr_SetString(PyExc_BufferError, SAMPLE_EXPIRED_MESSAGE);
+        return -1;
+    }
+    void *data = const_cast<uint8_t *>(state->block->data());
+    if (PyBuffer_FillInfo(view, self, data, static_cast<Py_ssize_t>(state->block->size()), 1, flags) < 0)
+        return -1;
+    state->exports++;
+    return 0;
+}
+
+void SampleBufferReleaseBuffer(PyObject *self, Py_buffer *)
+{
+    SampleBufferState *state = reinterpret_cast<SampleBufferObject *>(self)->state;
+    // The block goes back to the pool with the last view once the callback returned
+    if (--state->exports == 0 && state->closed)
+        state->block.reset();
+}
+
+void SampleBufferDealloc(PyObject *self)
+{
+    PyTypeObject *type = Py_TYPE(self);
+    delete reinterpret_cast<SampleBufferObject *>(self)->state;
+    type->tp_free(self);
+    Py_DECREF(type);
+}
+
+PyTypeObject *SampleBufferType()
+{
+    static PyType_Slot slots[] = {
+        {Py_tp_dealloc, reinterpret_cast<void *>(SampleBufferDealloc)},
+        {Py_bf_getbuffer, reinterpret_cast<void *>(SampleBufferGetBuffer)},
+        {Py_bf_releasebuffer, reinterpret_cast<void *>(SampleBufferReleaseBuffer)},
+        {0, nullptr}};
+    static PyType_Spec spec = {"chiaki_py.VideoSampleBuffer", sizeof(SampleBufferObject), 0,
+                               Py_TPFLAGS_DEFAULT | Py_TPFLAGS_DISALLOW_INSTANTIATION, slots};
+    // Created on first use with the GIL held, lives as long as the interpreter
+    static PyTypeObject *type = reinterpret_cast<PyTypeObject *>(PyType_FromSpec(&spec));
+    if (!type)
+    {
+        if (!PyErr_Occurred())
+            PyErr_SetString(PyExc_RuntimeError, "Failed to create the VideoSampleBuffer type");
+        throw py::error_already_set();
+    }
+    return type;
+}
+
+py::object NewSampleBuffer(VideoSamplePool::Block block)
+{
+    PyTypeObject *type = SampleBufferType();
+    PyObject *self = type->tp_alloc(type, 0);
+    if (!self)
+        throw py::error_already_set();
+    reinterpret_cast<SampleBufferObject *>(self)->state = new SampleBufferState{std::move(block)};
+    return py::reinterpret_steal<py::object>(self);
+}
+} // namespace
+
+PyVideoSample::PyVideoSample(VideoSamplePool::Block block, uint64_t index, bool keyframe, bool hevc, int32_t frames_lost, bool frame_recovered)
+    : block(std::move(block)),
+      sample_size(this->block ? this->block->size() : 0),
+      sample_index(index),
+      is_keyframe(keyframe),
+      hevc(hevc),
+      lost(frames_lost),
+      recovered(frame_recovered)
+{
+}
+
+py::memoryview PyVideoSample::data()
+{
+    if (!block)
+        throw py::value_error(SAMPLE_EXPIRED_MESSAGE);
+    if (!buffer)
+        buffer = NewSampleBuffer(block);
+    PyObject *view = PyMemoryView_FromObject(buffer.ptr());
+    if (!view)
+        throw py::error_already_set();
+    return py::reinterpret_steal<py::memoryview>(view);
+}
+
+py::list PyVideoSample::nal_units()
+{
+    if (!block)
+        throw py::value_error(SAMPLE_EXPIRED_MESSAGE);
+
+    // Slices share the export of the whole view, so they keep the block alive the same way
+    py::memoryview whole = data();
+    const uint8_t *base = block->data();
+    py::list units;
+    ForEachNalUnit(base, block->size(), [&](const uint8_t *nal, size_t nal_size)
+                   {
+        if (!nal_size)
+            return;
+        py::ssize_t start = nal - base;
+        py::object view = whole[py::slice(start, start + static_cast<py::ssize_t>(nal_size), 1)];
+        units.append(py::make_tuple(GetNalUnitType(nal, hevc), view)); });
+    return units;
+}
+
+py::bytes PyVideoSample::copy() const
+{
+    if (!block)
+        throw py::value_error("Video sample is only valid during the callback");
+    return py::bytes(reinterpret_cast<const char *>(block->data()), block->size());
+}
+
+void PyVideoSample::invalidate()
+{
+    if (buffer)
+    {
+        SampleBufferState *state = reinterpret_cast<SampleBufferObject *>(buffer.ptr())->state;
+        state->closed = true;
+        if (state->exports == 0)
+            state->block.reset();
+    }
+    block.reset();
+}
@@ -0,0 +1,367 @@
+#include "yuv_kernels.h"
+
+#include <cmath>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define CHIAKI_PY_YUV_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+// MSVC allows intrinsics of any instruction set in every function
+#define CHIAKI_PY_TARGET_AVX2
+#else
+#define CHIAKI_PY_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#endif
+
+#if defined(__ARM_NEON) || defined(_M_ARM64)
+#define CHIAKI_PY_YUV_NEON
+#include <arm_neon.h>
+#endif
+
+/**
+ * Fixed point coefficients shared by all kernels.
+ *
+ * Samples are centered and shifted left by 6, coefficients are stored as Q15 of a quarter of their value,
+ * so a rounding high multiply (pmulhrsw / vqrdmulh) yields the product in Q4 without leaving 16 bits.
+ */
+struct YuvCoefficients
+{
+    int16_t y_offset;
+    int16_t y;
+    int16_t v_r;
+    int16_t u_g;
+    int16_t v_g;
+    int16_t u_b;
+};
+
+static int16_t ToQ15Quarter(double coefficient)
+{
+    return (int16_t)std::lround(coefficient / 4.0 * 32768.0);
+}
+
+static YuvCoefficients MakeCoefficients(YuvColorMatrix matrix, bool full_range)
+{
+    double kr = matrix == YuvColorMatrix::BT709 ? 0.2126 : 0.299;
+    double kb = matrix == YuvColorMatrix::BT709 ? 0.0722 : 0.114;
+    double kg = 1.0 - kr - kb;
+    double y_scale = full_range ? 1.0 : 255.0 / 219.0;
+    double c_scale = full_range ? 1.0 : 255.0 / 224.0;
+
+    YuvCoefficients c;
+    c.y_offset = full_range ? 0 : 16;
+    c.y = ToQ15Quarter(y_scale);
+    c.v_r = ToQ15Quarter(2.0 * (1.0 - kr) * c_scale);
+    c.u_g = ToQ15Quarter(-2.0 * (1.0 - kb) * kb / kg * c_scale);
+    c.v_g = ToQ15Quarter(-2.0 * (1.0 - kr) * kr / kg * c_scale);
+    c.u_b = ToQ15Quarter(2.0 * (1.0 - kb) * c_scale);
+    return c;
+}
+
+static const YuvCoefficients &GetCoefficients(YuvColorMatrix matrix, bool full_range)
+{
+    static const YuvCoefficients coefficients[2][2] = {
+        {MakeCoefficients(YuvColorMatrix::BT601, false), MakeCoefficients(YuvColorMatrix::BT601, true)},
+        {MakeCoefficients(YuvColorMatrix::BT709, false), MakeCoefficients(YuvColorMatrix::BT709, true)}};
+    return coefficients[matrix == YuvColorMatrix::BT709 ? 1 : 0][full_range ? 1 : 0];
+}
+
+template <RgbPixelLayout L>
+struct LayoutTraits;
+
+template <>
+struct LayoutTraits<RgbPixelLayout::RGB24> { enum { bpp = 3, r = 0, g = 1, b = 2, a = -1 }; };
+template <>
+struct LayoutTraits<RgbPixelLayout::BGR24> { enum { bpp = 3, r = 2, g = 1, b = 0, a = -1 }; };
+template <>
+struct LayoutTraits<RgbPixelLayout::RGBA> { enum { bpp = 4, r = 0, g = 1, b = 2, a = 3 }; };
+template <>
+struct LayoutTraits<RgbPixelLayout::BGRA> { enum { bpp = 4, r = 2, g = 1, b = 0, a = 3 }; };
+
+typedef void (*YuvRowKernel)(const uint8_t *y, const uint8_t *u, const uint8_t *v, uint8_t *dst, int width, const YuvCoefficients &c);
+
+// Scalar model of the SIMD arithmetic, also used for the row tails
+
+static inline int MulHrs(int a, int b)
+{
+    return (a * b + 0x4000) >> 15;
+}
+
+static inline uint8_t PackQ4(int v)
+{
+    v = (v + 8) >> 4;
+    return (uint8_t)(v < 0 ? 0 : (v > 255 ? 255 : v));
+}
+
+template <bool NV12, RgbPixelLayout L>
+static void RowScalar(const uint8_t *y, const uint8_t *u, const uint8_t *v, uint8_t *dst, int width, const YuvCoefficients &c)
+{
+    typedef LayoutTraits<L> T;
+    for (int x = 0; x < width; x++)
+    {
+        int ci = NV12 ? (x & ~1) : (x >> 1);
+        int yy = MulHrs((y[x] - c.y_offset) << 6, c.y);
+        int uu = (u[ci] - 128) << 6;
+        int vv = (v[ci] - 128) << 6;
+        uint8_t *px = dst + x * T::bpp;
+        px[T::r] = PackQ4(yy + MulHrs(vv, c.v_r));
+        px[T::g] = PackQ4(yy + MulHrs(uu, c.u_g) + MulHrs(vv, c.v_g));
+        px[T::b] = PackQ4(yy + MulHrs(uu, c.u_b));
+        if (T::a >= 0)
+            px[T::a] = 0xff;
+    }
+}
+
+#ifdef CHIAKI_PY_YUV_X86
+
+// Interleaves 16 pixels of 8-bit channels into dst
+template <RgbPixelLayout L>
+CHIAKI_PY_TARGET_AVX2 static inline void StorePixels16(uint8_t *dst, __m128i r, __m128i g, __m128i b)
+{
+    typedef LayoutTraits<L> T;
+    __m128i c0 = T::r == 0 ? r : b;
+    __m128i c2 = T::r == 0 ? b : r;
+    if (T::bpp == 3)
+    {
+        const __m128i s00 = _mm_setr_epi8(0, -1, -1, 1, -1, -1, 2, -1, -1, 3, -1, -1, 4, -1, -1, 5);
+        const __m128i s01 = _mm_setr_epi8(-1, 0, -1, -1, 1, -1, -1, 2, -1, -1, 3, -1, -1, 4, -1, -1);
+        const __m128i s02 = _mm_setr_epi8(-1, -1, 0, -1, -1, 1, -1, -1, 2, -1, -1, 3, -1, -1, 4, -1);
+        const __m128i s10 = _mm_setr_epi8(-1, -1, 6, -1, -1, 7, -1, -1, 8, -1, -1, 9, -1, -1, 10, -1);
+        const __m128i s11 = _mm_setr_epi8(5, -1, -1, 6, -1, -1, 7, -1, -1, 8, -1, -1, 9, -1, -1, 10);
+        const __m128i s12 = _mm_setr_epi8(-1, 5, -1, -1, 6, -1, -1, 7, -1, -1, 8, -1, -1, 9, -1, -1);
+        const __m128i s20 = _mm_setr_epi8(-1, 11, -1, -1, 12, -1, -1, 13, -1, -1, 14, -1, -1, 15, -1, -1);
+        const __m128i s21 = _mm_setr_epi8(-1, -1, 11, -1, -1, 12, -1, -1, 13, -1, -1, 14, -1, -1, 15, -1);
+        const __m128i s22 = _mm_setr_epi8(10, -1, -1, 11, -1, -1, 12, -1, -1, 13, -1, -1, 14, -1, -1, 15);
+        __m128i o0 = _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(c0, s00), _mm_shuffle_epi8(g, s01)), _mm_shuffle_epi8(c2, s02));
+        __m128i o1 = _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(c0, s10), _mm_shuffle_epi8(g, s11)), _mm_shuffle_epi8(c2, s12));
+        __m128i o2 = _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(c0, s20), _mm_shuffle_epi8(g, s21)), _mm_shuffle_epi8(c2, s22));
+        _mm_storeu_si128((__m128i *)dst, o0);
+        _mm_storeu_si128((__m128i *)(dst + 16), o1);
+        _mm_storeu_si128((__m128i *)(dst + 32), o2);
+    }
+    else
+    {
+        const __m128i a = _mm_set1_epi8((char)0xff);
+        __m128i lo01 = _mm_unpacklo_epi8(c0, g);
+        __m128i hi01 = _mm_unpackhi_epi8(c0, g);
+        __m128i lo23 = _mm_unpacklo_epi8(c2, a);
+        __m128i hi23 = _mm_unpackhi_epi8(c2, a);
+        _mm_storeu_si128((__m128i *)dst, _mm_unpacklo_epi16(lo01, lo23));
+        _mm_storeu_si128((__m128i *)(dst + 16), _mm_unpackhi_epi16(lo01, lo23));
+        _mm_storeu_si128((__m128i *)(dst + 32), _mm_unpacklo_epi16(hi01, hi23));
+        _mm_storeu_si128((__m128i *)(dst + 48), _mm_unpackhi_epi16(hi01, hi23));
+    }
+}
+
+CHIAKI_PY_TARGET_AVX2 static inline __m128i PackQ4x16(__m256i v, __m256i round)
+{
+    v = _mm256_srai_epi16(_mm256_add_epi16(v, round), 4);
+    return _mm_packus_epi16(_mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1));
+}
+
+template <bool NV12, RgbPixelLayout L>
+CHIAKI_PY_TARGET_AVX2 static void RowAvx2(const uint8_t *y, const uint8_t *u, const uint8_t *v, uint8_t *dst, int width, const YuvCoefficients &c)
+{
+    typedef LayoutTraits<L> T;
+    const __m256i y_offset = _mm256_set1_epi16(c.y_offset);
+    const __m256i uv_offset = _mm256_set1_epi16(128);
+    const __m256i k_y = _mm256_set1_epi16(c.y);
+    const __m256i k_vr = _mm256_set1_epi16(c.v_r);
+    const __m256i k_ug = _mm256_set1_epi16(c.u_g);
+    const __m256i k_vg = _mm256_set1_epi16(c.v_g);
+    const __m256i k_ub = _mm256_set1_epi16(c.u_b);
+    const __m256i round = _mm256_set1_epi16(8);
+
+    int x = 0;
+    for (; x + 16 <= width; x += 16)
+    {
+        __m256i yv = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *)(y + x)));
+        __m256i uv_u, uv_v;
+        if (NV12)
+        {
+            // 8 UV pairs, duplicated so every pixel gets its own chroma sample
+            __m256i uv = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *)(u + x)));
+            uv_u = _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(uv, _MM_SHUFFLE(2, 2, 0, 0)), _MM_SHUFFLE(2, 2, 0, 0));
+            uv_v = _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(uv, _MM_SHUFFLE(3, 3, 1, 1)), _MM_SHUFFLE(3, 3, 1, 1));
+        }
+        else
+        {
+            __m128i u8 = _mm_loadl_epi64((const __m128i *)(u + x / 2));
+            __m128i v8 = _mm_loadl_epi64((const __m128i *)(v + x / 2));
+            uv_u = _mm256_cvtepu8_epi16(_mm_unpacklo_epi8(u8, u8));
+            uv_v = _mm256_cvtepu8_epi16(_mm_unpacklo_epi8(v8, v8));
+        }
+
+        yv = _mm256_slli_epi16(_mm256_sub_epi16(yv, y_offset), 6);
+        uv_u = _mm256_slli_epi16(_mm256_sub_epi16(uv_u, uv_offset), 6);
+        uv_v = _mm256_slli_epi16(_mm256_sub_epi16(uv_v, uv_offset), 6);
+
+        __m256i yy = _mm256_mulhrs_epi16(yv, k_y);
+        __m256i r = _mm256_add_epi16(yy, _mm256_mulhrs_epi16(uv_v, k_vr));
+        __m256i g = _mm256_add_epi16(_mm256_add_epi16(yy, _mm256_mulhrs_epi16(uv_u, k_ug)), _mm256_mulhrs_epi16(uv_v, k_vg));
+        __m256i b = _mm256_add_epi16(yy, _mm256_mulhrs_epi16(uv_u, k_ub));
+
+        StorePixels16<L>(dst + x * T::bpp, PackQ4x16(r, round), PackQ4x16(g, round), PackQ4x16(b, round));
+    }
+
+    if (x < width)
+    {
+        if (NV12)
+            RowScalar<NV12, L>(y + x, u + x, u + x + 1, dst + x * T::bpp, width - x, c);
+        else
+            RowScalar<NV12, L>(y + x, u + x / 2, v + x / 2, dst + x * T::bpp, width - x, c);
+    }
+}
+
+static bool CpuHasAvx2()
+{
+#ifdef _MSC_VER
+    int info[4];
+    __cpuid(info, 0);
+    if (info[0] < 7)
+        return false;
+    __cpuid(info, 1);
+    bool osxsave = (info[2] & (1 << 27)) != 0;
+    bool avx = (info[2] & (1 << 28)) != 0;
+    if (!osxsave || !avx || (_xgetbv(0) & 0x6) != 0x6)
+        return false;
+    __cpuidex(info, 7, 0);
+    return (info[1] & (1 << 5)) != 0;
+#else
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2");
+#endif
+}
+
+#endif // CHIAKI_PY_YUV_X86
+
+#ifdef CHIAKI_PY_YUV_NEON
+
+template <bool NV12, RgbPixelLayout L>
+static void RowNeon(const uint8_t *y, const uint8_t *u, const uint8_t *v, uint8_t *dst, int width, const YuvCoefficients &c)
+{
+    typedef LayoutTraits<L> T;
+    const int16x8_t y_offset = vdupq_n_s16(c.y_offset);
+    const int16x8_t uv_offset = vdupq_n_s16(128);
+    const int16x8_t k_y = vdupq_n_s16(c.y);
+    const int16x8_t k_vr = vdupq_n_s16(c.v_r);
+    const int16x8_t k_ug = vdupq_n_s16(c.u_g);
+    const int16x8_t k_vg = vdupq_n_s16(c.v_g);
+    const int16x8_t k_ub = vdupq_n_s16(c.u_b);
+
+    int x = 0;
+    for (; x + 16 <= width; x += 16)
+    {
+        uint8x16_t y8 = vld1q_u8(y + x);
+        uint8x8_t u8, v8;
+        if (NV12)
+        {
+            uint8x8x2_t uv = vld2_u8(u + x);
+            u8 = uv.val[0];
+            v8 = uv.val[1];
+        }
+        else
+        {
+            u8 = vld1_u8(u + x / 2);
+            v8 = vld1_u8(v + x / 2);
+        }
+        uint8x8x2_t u_dup = vzip_u8(u8, u8);
+        uint8x8x2_t v_dup = vzip_u8(v8, v8);
+
+        int16x8_t channels[3][2];
+        for (int half = 0; half < 2; half++)
+        {
+            uint8x8_t y_half = half ? vget_high_u8(y8) : vget_low_u8(y8);
+            int16x8_t yv = vshlq_n_s16(vsubq_s16(vreinterpretq_s16_u16(vmovl_u8(y_half)), y_offset), 6);
+            int16x8_t uu = vshlq_n_s16(vsubq_s16(vreinterpretq_s16_u16(vmovl_u8(u_dup.val[half])), uv_offset), 6);
+            int16x8_t vv = vshlq_n_s16(vsubq_s16(vreinterpretq_s16_u16(vmovl_u8(v_dup.val[half])), uv_offset), 6);
+
+            int16x8_t yy = vqrdmulhq_s16(yv, k_y);
+            channels[0][half] = vaddq_s16(yy, vqrdmulhq_s16(vv, k_vr));
+            channels[1][half] = vaddq_s16(vaddq_s16(yy, vqrdmulhq_s16(uu, k_ug)), vqrdmulhq_s16(vv, k_vg));
+            channels[2][half] = vaddq_s16(yy, vqrdmulhq_s16(uu, k_ub));
+        }
+
+        // vqrshrun adds the rounding term and saturates exactly like PackQ4()
+        uint8x16_t r = vcombine_u8(vqrshrun_n_s16(channels[0][0], 4), vqrshrun_n_s16(channels[0][1], 4));
+        uint8x16_t g = vcombine_u8(vqrshrun_n_s16(channels[1][0], 4), vqrshrun_n_s16(channels[1][1], 4));
+        uint8x16_t b = vcombine_u8(vqrshrun_n_s16(channels[2][0], 4), vqrshrun_n_s16(channels[2][1], 4));
+
+        if (T::bpp == 3)
+        {
+            uint8x16x3_t px;
+            px.val[T::r] = r;
+            px.val[T::g] = g;
+            px.val[T::b] = b;
+            vst3q_u8(dst + x * 3, px);
+        }
+        else
+        {
+            uint8x16x4_t px;
+            px.val[T::r] = r;
+            px.val[T::g] = g;
+            px.val[T::b] = b;
+            px.val[3] = vdupq_n_u8(0xff);
+            vst4q_u8(dst + x * 4, px);
+        }
+    }
+
+    if (x < width)
+    {
+        if (NV12)
+            RowScalar<NV12, L>(y + x, u + x, u + x + 1, dst + x * T::bpp, width - x, c);
+        else
+            RowScalar<NV12, L>(y + x, u + x / 2, v + x / 2, dst + x * T::bpp, width - x, c);
+    }
+}
+
+#endif // CHIAKI_PY_YUV_NEON
+
+struct YuvKernelTable
+{
+    const char *name;
+    // [chroma layout][pixel layout]
+    YuvRowKernel rows[2][4];
+};
+
+#define YUV_KERNEL_ROW(ROW, NV12) \
+    {ROW<NV12, RgbPixelLayout::RGB24>, ROW<NV12, RgbPixelLayout::BGR24>, ROW<NV12, RgbPixelLayout::RGBA>, ROW<NV12, RgbPixelLayout::BGRA>}
+
+static YuvKernelTable SelectKernels()
+{
+#ifdef CHIAKI_PY_YUV_X86
+    if (CpuHasAvx2())
+        return YuvKernelTable{"avx2", {YUV_KERNEL_ROW(RowAvx2, true), YUV_KERNEL_ROW(RowAvx2, false)}};
+#endif
+#ifdef CHIAKI_PY_YUV_NEON
+    return YuvKernelTable{"neon", {YUV_KERNEL_ROW(RowNeon, true), YUV_KERNEL_ROW(RowNeon, false)}};
+#else
+    return YuvKernelTable{"scalar", {YUV_KERNEL_ROW(RowScalar, true), YUV_KERNEL_ROW(RowScalar, false)}};
+#endif
+}
+
+static const YuvKernelTable &GetKernels()
+{
+    static const YuvKernelTable kernels = SelectKernels();
+    return kernels;
+}
+
+void ConvertYuvToRgb(const YuvImage &src, const RgbImage &dst, int y_begin, int y_end)
+{
+    const YuvCoefficients &c = GetCoefficients(src.matrix, src.full_range);
+    bool nv12 = src.chroma == YuvChromaLayout::NV12;
+    YuvRowKernel row = GetKernels().rows[nv12 ? 0 : 1][(int)dst.layout];
+
+    for (int y = y_begin; y < y_end; y++)
+    {
+        const uint8_t *y_row = src.planes[0] + (ptrdiff_t)y * src.strides[0];
+        const uint8_t *u_row = src.planes[1] + (ptrdiff_t)(y >> 1) * src.strides[1];
+        const uint8_t *v_row = nv12 ? u_row + 1 : src.planes[2] + (ptrdiff_t)(y >> 1) * src.strides[2];
+        row(y_row, u_row, v_row, dst.data + (ptrdiff_t)y * dst.stride, src.width, c);
+    }
+}
+
+const char *GetYuvKernelName()
+{
+    return GetKernels().name;
+}
@@ -1,7 +1,6 @@
 import sys
 from typing import Optional
 import time
-import threading
 import numpy as np
 import numpy.typing as npt
 from PyQt6.QtWidgets import QApplication, QLabel, QMainWindow
@@ -9,7 +8,7 @@ from PyQt6.QtGui import QImage, QPixmap, QCloseEvent
 from PyQt6.QtCore import QThread, pyqtSignal, pyqtSlot
 from PyQt6.QtWidgets import QVBoxLayout, QWidget
 from PyQt6.QtCore import Qt
-from chiaki_py import Settings, StreamSessionConnectInfo, StreamSession, get_frame
+from chiaki_py import Settings, StreamSessionConnectInfo, StreamSession, FrameResult, get_frame
 from chiaki_py.core.log import Log, LogLevel
 from chiaki_py.core.common import Target
 from chiaki_py.core.audio import AudioHeader
@@ -27,30 +26,27 @@ class FrameProducer(QThread):
         self.running = True  # Control flag
 
         self.stream_session = stream_session
-        self.stream_session.on_frame_available().subscribe(lambda a: self.ffmpeg_frame_available())
         self.frame = np.zeros((1080, 1920, 3), np.uint8)
-        self.frame_ready_event = threading.Event()
         self.max_fps = max_fps
         self.fps_limit = (1.0 / self.max_fps) if self.max_fps > 0 else 0
 
     def run(self):
-        """Continuously grab frames in a separate thread."""
+        """Fetch the latest frame at the display rate, frames decoded in between are skipped."""
+        next_frame = time.perf_counter()
         while self.running:
-            if self.frame_ready_event.wait():
-                start = time.perf_counter()
+            delay = next_frame - time.perf_counter()
+            if delay > 0:
+                time.sleep(delay)
+            # Blocks without the GIL until the decoder published a frame, the timeout only rechecks running
+            if not self.stream_session.wait_for_frame(100):
+                continue
+            if get_frame(self.stream_session, False, self.frame) == FrameResult.Success:
                 self.frame_ready.emit(self.frame)
-                self.frame_ready_event.clear()
-                end = time.perf_counter()
-                time.sleep(max(0, self.fps_limit - (end - start)))
-
-    def ffmpeg_frame_available(self):
-        get_frame(self.stream_session, False, self.frame)
-        self.frame_ready.emit(self.frame)
+                next_frame = time.perf_counter() + self.fps_limit
 
     def stop(self):
         """Stop the thread safely."""
         self.running = False
-        self.frame_ready_event.set()
         self.quit()
         self.wait()
 
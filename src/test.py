@@ -2,7 +2,7 @@ from typing import Any
 import threading
 import signal
 import sys
-from chiaki_py import Settings, StreamSessionConnectInfo, StreamSession, get_frame
+from chiaki_py import Settings, StreamSessionConnectInfo, StreamSession, FrameFormat, get_frame
 from chiaki_py.core.log import Log, LogLevel
 from chiaki_py.core.common import Target
 from chiaki_py.core.audio import AudioHeader
@@ -48,13 +48,11 @@ connect_info: StreamSessionConnectInfo = StreamSessionConnectInfo(
 )
 stream_session: StreamSession = StreamSession(connect_info)
 
-img = np.zeros((1080, 1920, 3), np.uint8)
 img_to_show = np.zeros((1080, 1920, 3), np.uint8)
 
 def get_ffmpeg_frame() -> None:
     """Get the frame from the stream session."""
-    get_frame(stream_session, False, img)
-    cv2.cvtColor(img, cv2.COLOR_RGB2BGR, img_to_show)
+    get_frame(stream_session, False, img_to_show, FrameFormat.BGR24)
 
 stream_session: StreamSession = StreamSession(connect_info)
 stream_session.on_frame_available().subscribe(lambda x: get_ffmpeg_frame())
@@ -0,0 +1,118 @@
+import gc
+import sys
+import threading
+import time
+from typing import Any, Callable, List
+from chiaki_py import Settings, StreamSessionConnectInfo, StreamSession
+from chiaki_py.core.common import Target
+
+# Exercises the event dispatcher without a console, the events are emitted by native threads of the session.
+# The session is only created, never started, so the host does not need to exist.
+# Needs a module built with -DCHIAKI_PY_TEST_HOOKS=ON, which binds StreamSession._emit_test_events.
+
+host = "127.0.0.1"
+frame_count = 10000
+thread_count = 4
+timeout = 10.0
+
+settings: Settings = Settings()
+settings.set_log_verbose(False)
+
+
+def create_session() -> StreamSession:
+    connect_info: StreamSessionConnectInfo = StreamSessionConnectInfo(
+        settings=settings,
+        target=Target.PS5_1,
+        host=host,
+        nickname="test",
+        regist_key="00000000",
+        morning=bytes(16),
+        initial_login_pin="",
+        duid="",
+        auto_regist=False,
+        fullscreen=False,
+        zoom=False,
+        stretch=False
+    )
+    return StreamSession(connect_info)
+
+
+def wait_until(condition: Callable[[], bool]) -> bool:
+    deadline = time.monotonic() + timeout
+    while not condition():
+        if time.monotonic() > deadline:
+            return False
+        time.sleep(0.01)
+    return True
+
+
+def test_flood() -> None:
+    """Frame available events from several native threads are coalesced, never lost or duplicated."""
+    session = create_session()
+    delivered = [0]
+    session.on_frame_available().subscribe(lambda x: delivered.__setitem__(0, delivered[0] + 1))
+
+    session._emit_test_events(frame_count, thread_count)
+    source = session.on_frame_available()
+    emitted = frame_count * thread_count
+    assert wait_until(lambda: delivered[0] + source.get_coalesced_count() == emitted), \
+        f"{delivered[0]} delivered + {source.get_coalesced_count()} coalesced != {emitted} emitted"
+    assert source.get_dropped_count() == 0
+    print(f"flood: {delivered[0]} delivered, {source.get_coalesced_count()} coalesced")
+
+
+def test_unsubscribe_in_callback() -> None:
+    """A subscriber that unsubscribes from its own callback is not called again."""
+    session = create_session()
+    calls = [0]
+    others = [0]
+    subscription: List[Any] = []
+
+    def on_frame(x: Any) -> None:
+        calls[0] += 1
+        subscription[0].unsubscribe()
+
+    subscription.append(session.on_frame_available().subscribe(on_frame))
+    session.on_frame_available().subscribe(lambda x: others.__setitem__(0, others[0] + 1))
+
+    session._emit_test_events(frame_count, thread_count)
+    assert wait_until(lambda: others[0] > 0)
+    before = others[0]
+    session._emit_test_events(frame_count, thread_count)
+    assert wait_until(lambda: others[0] > before)
+    assert calls[0] == 1, f"called {calls[0]} times after unsubscribing"
+    print(f"unsubscribe in callback: called once, other subscriber called {others[0]} times")
+
+
+def test_destroy_in_quit_callback() -> None:
+    """Dropping the last reference to a session from its own on_session_quit callback destroys it safely."""
+    sessions = [create_session()]
+    returned = threading.Event()
+    destroyed = threading.Event()
+
+    def on_quit(reason: Any) -> None:
+        # The call emitting the quit holds a reference until it returned, after that this one is the last
+        returned.wait(timeout)
+        sessions.clear()
+        gc.collect()
+        destroyed.set()
+
+    sessions[0].on_session_quit().subscribe(on_quit)
+    sessions[0].on_frame_available().subscribe(lambda x: None)
+    sessions[0]._emit_test_events(frame_count, thread_count, quit=True)
+    returned.set()
+    assert destroyed.wait(timeout), "on_session_quit was not delivered"
+    # Give the detached dispatch thread time to finish, a use after free usually crashes here
+    time.sleep(0.5)
+    print("destroy in quit callback: session destroyed")
+
+
+if __name__ == "__main__":
+    if not hasattr(StreamSession, "_emit_test_events"):
+        print("chiaki_py was built without CHIAKI_PY_TEST_HOOKS, skipping")
+        sys.exit(0)
+    test_flood()
+    test_unsubscribe_in_callback()
+    test_destroy_in_quit_callback()
+    print("All event dispatch tests passed")
+    sys.exit(0)